@@ -0,0 +1,312 @@
+#include "chatclient.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <stdexcept>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <unistd.h>
+
+using namespace std;
+
+// id อัตโนมัติตัวที่ 2 เป็นต้นไปอยู่เหนือช่วงของ pid ทั้งหมด (pid_max สูงสุดของ Linux คือ 2^22)
+// แต่ละ pid ได้ช่วงของตัวเอง 511 ค่า ซึ่งพอดีกับ int จึงไม่ชนกับ pid ของ process อื่นและไม่ชนกันข้าม process
+static const long long PID_LIMIT = 1LL << 22;
+static const long long IDS_PER_PID = ChatConnection::AUTO_IDS_PER_PROCESS - 1;
+
+static long long now_us() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int bucket_of(long long latency_us) {
+    if (latency_us <= 0) return 0;
+    int b = 64 - __builtin_clzll((unsigned long long)latency_us);
+    return min(b, ChatLatencyStats::BUCKETS - 1);
+}
+
+// ---- ChatLatencyStats ----
+
+double ChatLatencyStats::percentileMs(double p) const {
+    if (count == 0) return 0.0;
+    unsigned long long target = (unsigned long long)(count * p / 100.0);
+    if (target == 0) target = 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= target) return min<long long>(1LL << i, max_us) / 1000.0;
+    }
+    return max_us / 1000.0;
+}
+
+void ChatLatencyStats::merge(const ChatLatencyStats &other) {
+    if (other.count == 0) return;
+    min_us = count == 0 ? other.min_us : min(min_us, other.min_us);
+    max_us = max(max_us, other.max_us);
+    count += other.count;
+    sum_us += other.sum_us;
+    for (int i = 0; i < BUCKETS; ++i) buckets[i] += other.buckets[i];
+}
+
+// ---- ChatClient ----
+
+ChatClient::ChatClient(ChatConnection &conn, int id, MessageHandler handler)
+    : connection(conn), client_id(id), on_message(std::move(handler)), min_us(LLONG_MAX) {
+    for (auto &b : buckets) b.store(0, memory_order_relaxed);
+}
+
+bool ChatClient::send(const string &text) {
+    return connection.enqueue(client_id, text);
+}
+
+// เรียกจาก receiver thread ของ client นี้เท่านั้น ผู้อ่านสถิติอาจเห็นค่ากลางทางได้เล็กน้อยซึ่งยอมรับได้
+void ChatClient::record(long long latency_us) {
+    count.fetch_add(1, memory_order_relaxed);
+    sum_us.fetch_add(latency_us, memory_order_relaxed);
+    if (latency_us < min_us.load(memory_order_relaxed)) min_us.store(latency_us, memory_order_relaxed);
+    if (latency_us > max_us.load(memory_order_relaxed)) max_us.store(latency_us, memory_order_relaxed);
+    buckets[bucket_of(latency_us)].fetch_add(1, memory_order_relaxed);
+}
+
+ChatLatencyStats ChatClient::stats() const {
+    ChatLatencyStats s;
+    s.count = count.load(memory_order_relaxed);
+    if (s.count == 0) return s;
+    s.min_us = min_us.load(memory_order_relaxed);
+    s.max_us = max_us.load(memory_order_relaxed);
+    s.sum_us = sum_us.load(memory_order_relaxed);
+    for (int i = 0; i < ChatLatencyStats::BUCKETS; ++i) s.buckets[i] = buckets[i].load(memory_order_relaxed);
+    return s;
+}
+
+// ---- ChatConnection ----
+
+ChatConnection::Options ChatConnection::Options::fromEnvironment() {
+    Options o;
+    if (const char *v = getenv("CHAT_PROJ_ID")) o.proj_id = atoi(v);
+    if (const char *v = getenv("CHAT_MQ_NAME")) o.mq_name = v;
+    if (const char *v = getenv("CHAT_ID_BASE")) o.id_base = atoi(v);
+    return o;
+}
+
+ChatConnection::ChatConnection(const Options &options) : opts(options) {
+    if (opts.receive_threads <= 0) opts.receive_threads = 1;
+    if (opts.batch <= 0) opts.batch = 1;
+
+    key_t key = ftok(opts.key_path.c_str(), opts.proj_id);
+    if (key == -1) throw runtime_error(string("ftok failed: ") + strerror(errno));
+    msgid = msgget(key, 0666 | IPC_CREAT);
+    if (msgid == -1) throw runtime_error(string("msgget failed: ") + strerror(errno));
+
+    if (!opts.mq_name.empty()) {
+        mqd_t mq = mq_open(opts.mq_name.c_str(), O_WRONLY | O_NONBLOCK);
+        if (mq == (mqd_t)-1) throw runtime_error("mq_open " + opts.mq_name + " failed: " + strerror(errno));
+        router_mq = (int)mq;
+    }
+
+    sender = thread([this] { sendLoop(); });
+    for (int i = 0; i < opts.receive_threads; ++i) {
+        shards.push_back(make_unique<ReceiverShard>());
+        ReceiverShard *shard = shards.back().get();
+        shard->th = thread([this, shard] { receiveLoop(*shard); });
+    }
+}
+
+ChatConnection::~ChatConnection() {
+    stop();
+}
+
+ChatClient *ChatConnection::open(ChatClient::MessageHandler handler, int id) {
+    if (stopping.load()) return nullptr;
+
+    lock_guard<mutex> lock(clients_mtx);
+    if (id == 0) {
+        // ไม่มี id_base: client ตัวแรกใช้ pid เหมือน client แบบเดิม ตัวถัดไปใช้ช่วงของ pid นี้จนหมดแล้วปฏิเสธ
+        // (ไม่วนกลับไปใช้ค่าซ้ำ เพราะจะไปชน id ของ process อื่น)
+        long long pid = getpid();
+        do {
+            long long next;
+            if (opts.id_base > 0) next = (long long)opts.id_base + next_auto_id;
+            else if (next_auto_id == 0) next = pid;
+            else if (next_auto_id <= IDS_PER_PID) next = PID_LIMIT + pid * IDS_PER_PID + (next_auto_id - 1);
+            else return nullptr;
+            if (next > INT_MAX) return nullptr;
+            id = (int)next;
+            ++next_auto_id;
+        } while (any_of(clients.begin(), clients.end(), [id](const unique_ptr<ChatClient> &c) { return c->id() == id; }));
+    }
+    if (id <= 1) return nullptr; // msg_type 1 เป็นของ router
+    for (const auto &c : clients)
+        if (c->id() == id) return nullptr;
+
+    clients.push_back(unique_ptr<ChatClient>(new ChatClient(*this, id, std::move(handler))));
+    ChatClient *client = clients.back().get();
+
+    ReceiverShard &shard = *shards[(clients.size() - 1) % shards.size()];
+    {
+        lock_guard<mutex> shard_lock(shard.mtx);
+        shard.clients.push_back(client);
+    }
+    shard.version.fetch_add(1);
+    return client;
+}
+
+bool ChatConnection::enqueue(int client_id, const string &text) {
+    if (stopping.load()) return false;
+    {
+        lock_guard<mutex> lock(send_mtx);
+        send_queue.push_back(Outgoing{client_id, now_us(), text});
+    }
+    send_cv.notify_one();
+    return true;
+}
+
+bool ChatConnection::flush(int timeout_ms) {
+    unique_lock<mutex> lock(send_mtx);
+    return drained_cv.wait_for(lock, chrono::milliseconds(timeout_ms), [this] { return send_queue.empty() && !sending; });
+}
+
+void ChatConnection::stop() {
+    if (stopping.exchange(true)) return;
+
+    send_cv.notify_all();
+    if (sender.joinable()) sender.join();
+    for (auto &shard : shards)
+        if (shard->th.joinable()) shard->th.join();
+
+    if (router_mq != -1) {
+        mq_close((mqd_t)router_mq);
+        router_mq = -1;
+    }
+}
+
+ChatLatencyStats ChatConnection::stats() const {
+    ChatLatencyStats total;
+    lock_guard<mutex> lock(clients_mtx);
+    for (const auto &c : clients) total.merge(c->stats());
+    return total;
+}
+
+// ส่งแบบ IPC_NOWAIT แล้ว backoff เองเมื่อ queue เต็ม เพื่อให้ stop() ไม่ค้างใน msgsnd ตลอดไป
+bool ChatConnection::sendOne(const Outgoing &out) {
+    msg_buffer msg{};
+    msg.msg_type = 1; // ส่งไปยัง Server/Router
+    msg.client_pid = out.client_id;
+    msg.send_timestamp = out.timestamp;
+    strncpy(msg.msg_text, out.text.c_str(), sizeof(msg.msg_text) - 1);
+
+    int backoff_us = 50;
+    long long give_up_at = 0;
+    while (true) {
+        int rc = router_mq != -1 ? mq_send((mqd_t)router_mq, (const char *)&msg, sizeof(msg), 0)
+                                 : msgsnd(msgid, &msg, sizeof(msg) - sizeof(long), IPC_NOWAIT);
+        if (rc == 0) {
+            sent_count.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN) break;
+
+        // ระหว่างปิด ให้เวลา queue ระบายได้ไม่เกิน 1 วินาที
+        if (stopping.load()) {
+            if (give_up_at == 0) give_up_at = now_us() + 1000000;
+            else if (now_us() > give_up_at) break;
+        }
+        this_thread::sleep_for(chrono::microseconds(backoff_us));
+        backoff_us = min(backoff_us * 2, 2000);
+    }
+    send_errors.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+void ChatConnection::sendLoop() {
+    vector<Outgoing> batch;
+    while (true) {
+        {
+            unique_lock<mutex> lock(send_mtx);
+            sending = false;
+            if (send_queue.empty()) drained_cv.notify_all();
+            send_cv.wait(lock, [this] { return stopping.load() || !send_queue.empty(); });
+            if (send_queue.empty()) return; // stopping และไม่มีงานค้าง
+            batch.clear();
+            batch.swap(send_queue);
+            sending = true;
+        }
+        for (const auto &out : batch) sendOne(out);
+    }
+}
+
+// ไล่ดึงข้อความของ client ใน shard นี้ทีละตัวด้วย IPC_NOWAIT จนหมด (ไม่เกิน batch ต่อ client)
+// อ่านเวลาเพียงครั้งเดียวต่อรอบแล้วค่อยเรียก callback; ถ้ารอบไหนว่างทั้งหมดจะ sleep แบบ backoff สูงสุด 2 ms
+// ก่อนไล่ดู msg_qnum ครั้งเดียว ถ้า queue ว่างทั้งก้อนก็ไม่ต้อง msgrcv ทีละ client
+void ChatConnection::receiveLoop(ReceiverShard &shard) {
+    struct Received {
+        ChatClient *client;
+        msg_buffer msg;
+    };
+
+    vector<ChatClient *> local;
+    unsigned seen = ~0u;
+    vector<Received> batch;
+    int idle_us = 0;
+    bool queue_gone = false;
+
+    while (!stopping.load()) {
+        unsigned version = shard.version.load();
+        if (version != seen) {
+            lock_guard<mutex> lock(shard.mtx);
+            local = shard.clients;
+            seen = version;
+        }
+
+        batch.clear();
+        msqid_ds ds;
+        bool queue_empty = msgctl(msgid, IPC_STAT, &ds) == 0 && ds.msg_qnum == 0;
+        if (!queue_empty) {
+            for (ChatClient *client : local) {
+                for (int i = 0; i < opts.batch; ++i) {
+                    Received r;
+                    r.client = client;
+                    if (msgrcv(msgid, &r.msg, sizeof(r.msg) - sizeof(long), client->id(), IPC_NOWAIT | MSG_NOERROR) < 0) {
+                        if ((errno == EIDRM || errno == EINVAL) && !queue_gone) {
+                            queue_gone = true;
+                            perror("[ChatConnection] message queue removed");
+                        }
+                        break;
+                    }
+                    batch.push_back(r);
+                }
+            }
+        }
+
+        if (batch.empty()) {
+            idle_us = idle_us == 0 ? 50 : min(idle_us * 2, 2000);
+            this_thread::sleep_for(chrono::microseconds(idle_us));
+            continue;
+        }
+        idle_us = 0;
+
+        long long now = now_us();
+        for (auto &r : batch) {
+            long long latency = now - r.msg.send_timestamp;
+            r.client->record(latency);
+            if (!r.client->on_message) continue;
+            try {
+                r.client->on_message(*r.client, r.msg, latency);
+            } catch (const exception &e) {
+                fprintf(stderr, "[ChatConnection] Message handler error: %s\n", e.what());
+            } catch (...) {
+                fprintf(stderr, "[ChatConnection] Unknown error in message handler.\n");
+            }
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef CHATCLIENT_H
+#define CHATCLIENT_H
+
+// chatclient: ไลบรารี client แบบ headless สำหรับ bot และ load generator
+// - process เดียวถือ logical client ได้หลายตัว (แต่ละตัวมี id ของตัวเองใช้เป็น msg_type)
+// - ส่งแบบ async: send() แค่ต่อคิว thread ส่งจะ msgsnd เป็น batch
+// - รับแบบ batch: receiver thread ไล่ดูดข้อความของแต่ละ client ด้วย IPC_NOWAIT จนหมด แล้วค่อยเรียก callback
+// - เก็บสถิติ latency ไว้ใน process ไม่พิมพ์ออกจอ
+// - stop() ปิดได้เรียบร้อยโดยไม่ต้องใช้ pthread_cancel
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct msg_buffer {
+    long msg_type;
+    int client_pid;
+    char msg_text[256];
+    long long send_timestamp;
+};
+
+// สถิติ latency (microseconds) แบบ histogram ช่องละยกกำลัง 2
+struct ChatLatencyStats {
+    static const int BUCKETS = 32;
+
+    unsigned long long count = 0;
+    long long min_us = 0;
+    long long max_us = 0;
+    long long sum_us = 0;
+    unsigned long long buckets[BUCKETS] = {}; // ช่อง i นับ latency ในช่วง [2^(i-1), 2^i) us
+
+    double meanMs() const { return count ? sum_us / 1000.0 / count : 0.0; }
+    // ค่าประมาณ (ขอบบนของช่อง) ของ percentile p (0-100) เป็น ms
+    double percentileMs(double p) const;
+    void merge(const ChatLatencyStats &other);
+};
+
+class ChatConnection;
+
+// logical client หนึ่งตัว สร้างผ่าน ChatConnection::open() และมีอายุเท่ากับ connection
+class ChatClient {
+public:
+    using MessageHandler = std::function<void(ChatClient &client, const msg_buffer &msg, long long latency_us)>;
+
+    int id() const { return client_id; }
+
+    // ส่งข้อความดิบ (เช่น "say room hello") แบบ async คืน false ถ้า connection ปิดแล้ว
+    bool send(const std::string &text);
+    bool join(const std::string &room) { return send("join " + room); }
+    bool leave(const std::string &room) { return send("leave " + room); }
+    bool say(const std::string &room, const std::string &text) { return send("say " + room + " " + text); }
+    bool dm(int target, const std::string &text) { return send("dm " + std::to_string(target) + " " + text); }
+
+    ChatLatencyStats stats() const;
+    unsigned long long received() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    friend class ChatConnection;
+
+    ChatClient(ChatConnection &conn, int id, MessageHandler handler);
+    void record(long long latency_us);
+
+    ChatConnection &connection;
+    int client_id;
+    MessageHandler on_message;
+
+    std::atomic<unsigned long long> count{0};
+    std::atomic<long long> min_us{0};
+    std::atomic<long long> max_us{0};
+    std::atomic<long long> sum_us{0};
+    std::atomic<unsigned long long> buckets[ChatLatencyStats::BUCKETS];
+};
+
+class ChatConnection {
+public:
+    struct Options {
+        std::string key_path = "progfile"; // ไฟล์สำหรับ ftok ต้องตรงกับ router
+        int proj_id = 65;                  // CHAT_PROJ_ID
+        std::string mq_name;               // CHAT_MQ_NAME: ส่งเข้า POSIX mq ของ reactor backend แทน System V queue
+        int receive_threads = 1;           // client ถูกแบ่งให้ receiver แต่ละตัวแบบ round-robin
+        int batch = 64;                    // ดึงได้สูงสุดต่อ client ต่อรอบ
+        int id_base = 0;                   // CHAT_ID_BASE: id อัตโนมัติเป็น id_base, id_base+1, ... (0 = สร้างจาก pid)
+
+        // ค่าเริ่มต้นจาก env CHAT_PROJ_ID / CHAT_MQ_NAME / CHAT_ID_BASE
+        static Options fromEnvironment();
+    };
+
+    // จำนวน id อัตโนมัติที่สร้างจาก pid ได้ต่อ process (รวม pid เอง) เกินนี้ต้องกำหนด id_base
+    static const int AUTO_IDS_PER_PROCESS = 512;
+
+    explicit ChatConnection(const Options &options = Options::fromEnvironment());
+    ~ChatConnection();
+
+    ChatConnection(const ChatConnection &) = delete;
+    ChatConnection &operator=(const ChatConnection &) = delete;
+
+    // สร้าง logical client ใหม่; id = 0 ให้ไลบรารีเลือก id เอง (จาก id_base หรือ pid)
+    // คืน nullptr ถ้า id ซ้ำ/ไม่ถูกต้อง, id อัตโนมัติหมด หรือ connection ปิดแล้ว
+    ChatClient *open(ChatClient::MessageHandler handler, int id = 0);
+
+    // รอให้คิวส่งว่าง (หรือจนหมดเวลา) คืน true ถ้าส่งครบ
+    bool flush(int timeout_ms = 5000);
+
+    // หยุดรับ/ส่งและ join thread ทั้งหมด; ข้อความที่ยังค้างในคิวส่งจะถูกส่งก่อนปิด
+    void stop();
+
+    ChatLatencyStats stats() const;
+    unsigned long long sent() const { return sent_count.load(std::memory_order_relaxed); }
+    unsigned long long sendErrors() const { return send_errors.load(std::memory_order_relaxed); }
+
+private:
+    friend class ChatClient;
+
+    struct ReceiverShard {
+        std::mutex mtx;
+        std::vector<ChatClient *> clients;
+        std::atomic<unsigned> version{0};
+        std::thread th;
+    };
+
+    struct Outgoing {
+        int client_id;
+        long long timestamp;
+        std::string text;
+    };
+
+    bool enqueue(int client_id, const std::string &text);
+    void receiveLoop(ReceiverShard &shard);
+    void sendLoop();
+    bool sendOne(const Outgoing &out);
+
+    Options opts;
+    int msgid = -1;
+    int router_mq = -1;
+    std::atomic<bool> stopping{false};
+
+    mutable std::mutex clients_mtx;
+    std::vector<std::unique_ptr<ChatClient>> clients;
+    int next_auto_id = 0;
+
+    std::vector<std::unique_ptr<ReceiverShard>> shards;
+
+    std::mutex send_mtx;
+    std::condition_variable send_cv;
+    std::condition_variable drained_cv;
+    std::vector<Outgoing> send_queue;
+    bool sending = false;
+    std::thread sender;
+
+    std::atomic<unsigned long long> sent_count{0};
+    std::atomic<unsigned long long> send_errors{0};
+};
+
+#endif
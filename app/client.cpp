@@ -1,52 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/ipc.h>
-#include <sys/msg.h>
 #include <string.h>
 #include <unistd.h>
-#include <pthread.h>
-#include <sys/time.h>
+#include <stdexcept>
+#include "chatclient.h"
 
-struct msg_buffer
-{
-    long msg_type;
-    int client_pid;
-    char msg_text[256];
-    long long send_timestamp;
-};
-
-int msgid;
-int current_pid;
-volatile int running = 1;
+// client แบบ interactive: ส่วน transport (ส่ง/รับ/latency) อยู่ใน libchatclient ไฟล์นี้เหลือแค่ prompt
+// ตั้ง CHAT_PROJ_ID / CHAT_MQ_NAME ให้ตรงกับ router ได้ผ่าน env (ดู ChatConnection::Options)
 
-// Thread รับข้อความ
+ChatClient *self;
 
-void *receive_messages(void *arg)
+// แสดงข้อความที่ได้รับ (เรียกจาก receiver thread ของไลบรารี)
+void print_message(ChatClient &, const msg_buffer &msg, long long latency_us)
 {
-    struct msg_buffer msg;
-    while (running)
-    {
-        // ใช้ MSG_NOERROR เพื่อป้องกัน buffer overflow หรือ error เมื่อข้อความยาวเกิน
-        if (msgrcv(msgid, &msg, sizeof(msg) - sizeof(long), current_pid, MSG_NOERROR) >= 0)
-        {
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            long long recv_time = (long long)now.tv_sec * 1000000LL + now.tv_usec;
-            long long latency_us = recv_time - msg.send_timestamp;
-
-            printf("\r");
+    printf("\r");
 
-            printf("%s\n", msg.msg_text);
+    printf("%s\n", msg.msg_text);
 
-            // แสดง Latency
-            printf("[Latency]: %.3f ms\n", latency_us / 1000.0);
+    // แสดง Latency
+    printf("[Latency]: %.3f ms\n", latency_us / 1000.0);
 
-            // แสดง prompt "เขียนข้อความ: " ขึ้นมาใหม่ทันที
-            printf("เขียนข้อความ: ");
-            fflush(stdout); // บังคับให้แสดงผลทันที
-        }
-    }
-    return NULL;
+    // แสดง prompt "เขียนข้อความ: " ขึ้นมาใหม่ทันที
+    printf("เขียนข้อความ: ");
+    fflush(stdout); // บังคับให้แสดงผลทันที
 }
 
 // ส่งข้อความจากไฟล์
@@ -60,9 +36,7 @@ void send_messages_from_file(const char *command, const char *target, const char
     }
 
     char line[256];
-    struct msg_buffer message;
-    message.msg_type = 1; // ส่งไปยัง Server/Router (msg_type 1)
-    message.client_pid = current_pid;
+    char text[256];
 
     while (fgets(line, sizeof(line), file))
     {
@@ -70,19 +44,17 @@ void send_messages_from_file(const char *command, const char *target, const char
         if (len > 0 && line[len - 1] == '\n')
             line[len - 1] = '\0';
 
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        message.send_timestamp = (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
-
         if (strcmp(command, "say") == 0)
-            snprintf(message.msg_text, sizeof(message.msg_text), "say %s %s", target, line);
+            snprintf(text, sizeof(text), "say %s %s", target, line);
         else if (strcmp(command, "dm") == 0)
-            snprintf(message.msg_text, sizeof(message.msg_text), "dm %s %s", target, line);
+            snprintf(text, sizeof(text), "dm %s %s", target, line);
+        else
+            break;
 
-        if (msgsnd(msgid, &message, sizeof(message) - sizeof(long), 0) == -1)
-            perror("msgsnd failed");
+        if (!self->send(text))
+            fprintf(stderr, "send failed\n");
         else
-            printf("[Sent]: %s\n", message.msg_text);
+            printf("[Sent]: %s\n", text);
 
         usleep(100000); // หน่วงเวลา 100ms ระหว่างข้อความ
     }
@@ -93,54 +65,50 @@ void send_messages_from_file(const char *command, const char *target, const char
 // ฟังค์ชัน main
 int main()
 {
-    key_t key;
-    struct msg_buffer message;
-
-    current_pid = getpid();
-    // ต้องใช้ key เดียวกับฝั่ง Server/Router
-    key = ftok("progfile", 65);
-    msgid = msgget(key, 0666 | IPC_CREAT);
-    if (msgid == -1)
+    char input[256];
+
+    ChatConnection *conn;
+    try
+    {
+        conn = new ChatConnection();
+    }
+    catch (const std::exception &e)
     {
-        perror("msgget");
+        fprintf(stderr, "%s\n", e.what());
         exit(1);
     }
 
-    pthread_t recv_tid;
-    pthread_create(&recv_tid, NULL, receive_messages, NULL);
-
-    message.msg_type = 1; // ส่งไปยัง Server/Router (msg_type 1)
-    snprintf(message.msg_text, sizeof(message.msg_text), "help");
-    message.client_pid = current_pid;
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    // เก็บ timestamp เป็น microseconds
-    message.send_timestamp = (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
+    // client ตัวเดียวใช้ pid เป็น id เหมือนเดิม
+    self = conn->open(print_message);
+    if (!self)
+    {
+        fprintf(stderr, "Cannot open client\n");
+        exit(1);
+    }
 
-    if (msgsnd(msgid, &message, sizeof(message) - sizeof(long), 0) == -1)
-        perror("msgsnd failed");
+    self->send("help");
 
     printf("Client started. พิมพ์ 'quit' เพื่อออก\n");
-    printf("client id: %d\n", current_pid);
+    printf("client id: %d\n", self->id());
 
     while (1)
     {
         printf("เขียนข้อความ: ");
         fflush(stdout); // บังคับให้แสดง Prompt ทันที
 
-        if (fgets(message.msg_text, sizeof(message.msg_text), stdin) == NULL)
+        if (fgets(input, sizeof(input), stdin) == NULL)
             break;
 
-        size_t len = strlen(message.msg_text);
-        if (len > 0 && message.msg_text[len - 1] == '\n')
-            message.msg_text[len - 1] = '\0';
-        if (strcmp(message.msg_text, "quit") == 0)
+        size_t len = strlen(input);
+        if (len > 0 && input[len - 1] == '\n')
+            input[len - 1] = '\0';
+        if (strcmp(input, "quit") == 0)
             break;
 
-        if (strncmp(message.msg_text, "file ", 5) == 0)
+        if (strncmp(input, "file ", 5) == 0)
         {
             char cmd[10], target[50], filename[100];
-            int n = sscanf(message.msg_text + 5, "%s %s %s", cmd, target, filename);
+            int n = sscanf(input + 5, "%9s %49s %99s", cmd, target, filename);
             if (n == 3)
                 send_messages_from_file(cmd, target, filename);
             else
@@ -148,22 +116,14 @@ int main()
             continue;
         }
 
-        message.msg_type = 1; // ส่งไปยัง Server/Router (msg_type 1)
-        message.client_pid = current_pid;
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        // เก็บ timestamp เป็น microseconds
-        message.send_timestamp = (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
-
-        if (msgsnd(msgid, &message, sizeof(message) - sizeof(long), 0) == -1)
-            perror("msgsnd failed");
+        if (!self->send(input))
+            fprintf(stderr, "send failed\n");
     }
 
-    running = 0;
-    // ใช้ pthread_cancel เพื่อปลดบล็อก msgrcv ที่รออยู่
-    pthread_cancel(recv_tid);
-    pthread_join(recv_tid, NULL);
-    // ลบ msgctl(msgid, IPC_RMID, NULL); ออก เพราะ client ไม่ควรเป็นคนลบ queue
+    // stop() ส่งข้อความที่ค้างให้หมดแล้วหยุด receiver เองโดยไม่ต้อง pthread_cancel
+    // client ไม่ลบ queue เพราะเป็นของ router
+    conn->stop();
+    delete conn;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,136 +1,109 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/ipc.h>
-#include <sys/msg.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/wait.h>
-#include <pthread.h>
-#include <sys/time.h>
-
-struct msg_buffer {
-    long msg_type;
-    int client_pid;
-    char msg_text[256];
-    long long send_timestamp;
-};
-
-int msgid;
-int current_pid;
-volatile int running = 1;
-
-
-// Thread รับข้อความ
-void* receive_messages(void* arg) {
-    struct msg_buffer msg;
-    while (running) {
-        if (msgrcv(msgid, &msg, sizeof(msg) - sizeof(long), current_pid, 0) >= 0) {
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            long long recv_time = (long long)now.tv_sec * 1000000LL + now.tv_usec;
-            long long latency_us = recv_time - msg.send_timestamp;
-
-            printf("\n%s\n", msg.msg_text);
-            printf("[Latency]: %.3f ms\n", latency_us / 1000.0);
-            fflush(stdout);
-        }
-    }
-    return NULL;
-}
+#include <stdexcept>
+#include <vector>
+#include "chatclient.h"
 
+// จำลอง client หลายตัวใน process เดียวด้วย logical client ของ libchatclient (ไม่ต้อง fork ต่อ client)
+// ไม่พิมพ์ข้อความที่ได้รับ แสดงเฉพาะสรุป throughput/latency ตอนจบ
 
-// ส่งข้อความจากไฟล์
-void send_messages_from_file(const char* command, const char* target, const char* filename) {
+
+// ส่งข้อความจากไฟล์: ทุก client ส่งบรรทัดเดียวกันแล้วเว้น delay_us ก่อนบรรทัดถัดไป
+int send_messages_from_file(std::vector<ChatClient*>& clients, const char* command, const char* target,
+                            const char* filename, int delay_us) {
     // เปิดไฟล์
     FILE* file = fopen(filename, "r");
-    if (!file) { perror("fopen"); return; }
+    if (!file) { perror("fopen"); return 0; }
 
     char line[256];
-    struct msg_buffer message;
-    message.msg_type = 1;
-    message.client_pid = current_pid;
-
+    char text[256];
+    int lines = 0;
 
     // อ่านแต่ละบรรทัดและส่งข้อความ
     while (fgets(line, sizeof(line), file)) {
         size_t len = strlen(line);
         if (len > 0 && line[len-1] == '\n') line[len-1] = '\0';
+        if (line[0] == '\0') continue;
+
+        snprintf(text, sizeof(text), "%s %s %s", command, target, line);
+        for (ChatClient* c : clients)
+            c->send(text);
+        ++lines;
 
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        message.send_timestamp = (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
-
-        if (strcmp(command, "say") == 0)
-            snprintf(message.msg_text, sizeof(message.msg_text), "say %s %s", target, line);
-        else if (strcmp(command, "dm") == 0)
-            snprintf(message.msg_text, sizeof(message.msg_text), "dm %s %s", target, line);
-
-        if (msgsnd(msgid, &message, sizeof(message) - sizeof(long), 0) == -1)
-            perror("msgsnd failed");
-        else
-            printf("[Sent]: %s\n", message.msg_text);
-        // รอเล็กน้อยระหว่างการส่งข้อความ
-        usleep(100000);
+        if (delay_us > 0) usleep(delay_us);
     }
 
     fclose(file);
+    return lines;
 }
 
 
 // โปรแกรมหลัก
-int main() {
+int main(int argc, char** argv) {
     int num_clients;
     char group_name[64];
+    // argv[1] = ไฟล์ข้อความ, argv[2] = หน่วงระหว่างบรรทัด (us, 0 = ส่งเต็มความเร็ว)
+    const char* filename = argc > 1 ? argv[1] : "test/shorttest.txt";
+    int delay_us = argc > 2 ? atoi(argv[2]) : 100000;
 
     printf("Enter number of clients: ");
-    scanf("%d", &num_clients);
+    if (scanf("%d", &num_clients) != 1 || num_clients <= 0) { fprintf(stderr, "Invalid number of clients\n"); return 1; }
     getchar(); // consume newline
     printf("Enter group name: ");
-    fgets(group_name, sizeof(group_name), stdin);
+    if (!fgets(group_name, sizeof(group_name), stdin)) return 1;
     size_t len = strlen(group_name);
     if (len > 0 && group_name[len-1] == '\n') group_name[len-1] = '\0';
 
-    key_t key = ftok("progfile", 65);
-    msgid = msgget(key, 0666 | IPC_CREAT);
-    if (msgid == -1) { perror("msgget"); exit(1); }
+    ChatConnection::Options opts = ChatConnection::Options::fromEnvironment();
+    opts.receive_threads = num_clients >= 1000 ? 4 : 1;
 
-    for (int i = 0; i < num_clients; ++i) {
-        pid_t pid = fork();
-        if (pid == 0) { // child process = client
-            current_pid = getpid();
-            pthread_t recv_tid;
-            pthread_create(&recv_tid, NULL, receive_messages, NULL);
-
-            printf("Client %d started. PID: %d\n", i+1, current_pid);
-
-            // Join group (room)
-            struct msg_buffer join_msg;
-            join_msg.msg_type = 1;
-            join_msg.client_pid = current_pid;
-            struct timeval tv;
-            gettimeofday(&tv, NULL);
-            join_msg.send_timestamp = (long long)tv.tv_sec * 1000000LL + tv.tv_usec;
-            snprintf(join_msg.msg_text, sizeof(join_msg.msg_text), "join %s", group_name);
-            if (msgsnd(msgid, &join_msg, sizeof(join_msg) - sizeof(long), 0) == -1)
-                perror("msgsnd failed (join)");
-            else
-                printf("[Client %d] Joined group: %s\n", i+1, group_name);
-
-            // Say with file
-            send_messages_from_file("say", group_name, "test/eng.txt");
-
-            sleep(1); // allow time for messages to be received
-            running = 0;
-            pthread_cancel(recv_tid);
-            pthread_join(recv_tid, NULL);
-            exit(0);
-        }
+    ChatConnection* conn;
+    try {
+        conn = new ChatConnection(opts);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
     }
 
-    // wait child processes
+    std::vector<ChatClient*> clients;
     for (int i = 0; i < num_clients; ++i) {
-        wait(NULL);
+        ChatClient* c = conn->open(nullptr); // ไม่ต้องมี callback ไลบรารีนับและเก็บ latency ให้
+        if (!c) {
+            fprintf(stderr, "Cannot open client %d", i + 1);
+            if (opts.id_base == 0 && i >= ChatConnection::AUTO_IDS_PER_PROCESS)
+                fprintf(stderr, " (set CHAT_ID_BASE for more than %d clients)", ChatConnection::AUTO_IDS_PER_PROCESS);
+            fprintf(stderr, "\n");
+            break;
+        }
+        c->join(group_name);
+        clients.push_back(c);
     }
+    printf("%zu clients joined group: %s\n", clients.size(), group_name);
+    conn->flush();
+    usleep(200000); // รอ router ประมวลผล join
+
+    int lines = send_messages_from_file(clients, "say", group_name, filename, delay_us);
+    conn->flush();
+
+    // รอจนได้รับครบ (ทุก client ได้ทุกข้อความจากทุก client) หรือไม่มีอะไรเข้ามาเพิ่ม 1 วินาที
+    unsigned long long expected = (unsigned long long)lines * clients.size() * clients.size();
+    unsigned long long last = 0;
+    for (int idle_ms = 0; idle_ms < 1000; idle_ms += 50) {
+        unsigned long long got = 0;
+        for (ChatClient* c : clients) got += c->received();
+        if (got >= expected + clients.size()) break; // รวม [INFO] ตอบ join
+        if (got != last) { last = got; idle_ms = 0; }
+        usleep(50000);
+    }
+
+    conn->stop();
+    ChatLatencyStats st = conn->stats();
+    printf("Sent: %llu (errors %llu), Received: %llu\n", conn->sent(), conn->sendErrors(), st.count);
+    printf("[Latency] mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           st.meanMs(), st.percentileMs(50), st.percentileMs(99), st.max_us / 1000.0);
 
+    delete conn;
     return 0;
-}
\ No newline at end of file
+}
@@ -1,8 +1,11 @@
 
 
-g++ client.cpp -o client
+g++ -c chatclient.cpp -o chatclient.o && ar rcs libchatclient.a chatclient.o
 
 
-g++ server.cpp -o server
+g++ client.cpp -o client -L. -lchatclient -pthread -lrt
 
-g++ clientsim.cpp -o clientsim
\ No newline at end of file
+
+g++ server.cpp -o server -pthread -lrt
+
+g++ clientsim.cpp -o clientsim -L. -lchatclient -pthread -lrt
@@ -0,0 +1,21 @@
+#!/bin/bash
+# รัน router หลายตัวในเครื่องเดียวแบบ federation (ค่าเริ่มต้น 3 ตัว, port 7001..)
+# client ของ router ตัวที่ i ใช้: CHAT_PROJ_ID=$((65 + i - 1)) ./client
+
+COUNT=${1:-3}
+BASE_PORT=${2:-7001}
+THREADS=${THREADS:-4}
+
+PEERS=""
+for ((i = 0; i < COUNT; i++)); do
+    PEERS="$PEERS --peer=127.0.0.1:$((BASE_PORT + i))"
+done
+
+for ((i = 0; i < COUNT; i++)); do
+    PORT=$((BASE_PORT + i))
+    PROJ=$((65 + i))
+    ./server --threads=$THREADS --proj-id=$PROJ --node=127.0.0.1:$PORT $PEERS > "router-$PORT.log" 2>&1 &
+    echo "Router $((i + 1)): node 127.0.0.1:$PORT, CHAT_PROJ_ID=$PROJ, pid $!, log router-$PORT.log"
+done
+
+echo "หยุดทั้งหมดด้วย: pkill -x server"
@@ -15,14 +15,36 @@
 #include <ctime>
 #include <chrono>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <set>
+#include <shared_mutex>
+#include <fstream>
+#include <array>
+#include <list>
+#include <deque>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
 
 using namespace std;
 using namespace std::chrono;
 
 
-int CONFIG_BC_THREAD;
-
-
 struct msg_buffer {
     long msg_type;
     int client_pid;
@@ -32,40 +54,127 @@ struct msg_buffer {
 
 int msgid;
 
+// ตัวเลือกของ server อ่านจากไฟล์ config (config=<path>) แล้วทับด้วย env CHAT_<KEY> และ argv --<key>=<value> ตามลำดับ
+// ชื่อ key ในคอมเมนต์ด้านล่าง (env ใช้ตัวพิมพ์ใหญ่และ '_' แทน '-' เช่น inbound-threads -> CHAT_INBOUND_THREADS)
+struct ServerOptions {
+    bool reactor = false;            // reactor : ใช้ POSIX mq + epoll แทน msgrcv แบบ blocking
+    string mq_name = "/chat-router"; // mq-name : ชื่อ POSIX message queue ขาเข้า
+    int loops = 0;                   // loops : จำนวน event loop (0 = ตามจำนวน core)
+    int proj_id = 65;                // proj-id : project id ของ ftok (แยก queue เมื่อรันหลาย router ในเครื่องเดียว)
+    string filter_file;              // filter-file : รายการคำ/URL ต้องห้าม (บรรทัดละ 1, reload อัตโนมัติเมื่อไฟล์เปลี่ยน)
+    string node;                     // node=<host:port> : เปิด federation และใช้ที่อยู่นี้เป็นทั้ง listen address และชื่อ node
+    vector<string> peers;            // peer=<host:port> : router อื่นใน federation (ระบุซ้ำหรือคั่นด้วย ',' ได้)
+
+    // pool ขาเข้า (handleMessage) และขาออก (msgsnd ไปยังผู้รับ) แยกขนาดกัน; threads กำหนดค่าเริ่มต้นให้ทั้งสอง
+    size_t inbound_threads = 0;      // inbound-threads (0 = ตามจำนวน core)
+    size_t outbound_threads = 0;     // outbound-threads (0 = ตามจำนวน core)
+    size_t inbound_min = 1;          // inbound-min
+    size_t inbound_max = 0;          // inbound-max (0 = 4 เท่าของจำนวน core)
+    size_t outbound_min = 1;         // outbound-min
+    size_t outbound_max = 0;         // outbound-max (0 = 4 เท่าของจำนวน core)
+    vector<int> inbound_cpus;        // inbound-cpus=0-3,8 : CPU affinity ของ pool ขาเข้า
+    vector<int> outbound_cpus;       // outbound-cpus : CPU affinity ของ pool ขาออก
+    bool autoscale = true;           // autoscale : ปรับขนาด pool ตาม backlog/latency/ความลึกของ queue
+    int autoscale_interval_ms = 500; // autoscale-interval-ms
+    size_t search_retention = 100000; // search-retention : จำนวนข้อความล่าสุดต่อห้องที่ค้นหาได้ (0 = ไม่จำกัด)
+};
+
 // ThreadPool สำหรับจัดการ concurrent tasks
+// ปรับจำนวน worker ได้ระหว่างรัน (resize) และเก็บสถิติ backlog/เวลารอในคิวให้ autoscaler ใช้ตัดสินใจ
 class ThreadPool {
-    vector<thread> workers;
-    queue<function<void()>> tasks;
+    struct Worker {
+        thread th;
+        bool done = false; // ป้องกันด้วย queue_mutex
+    };
+    struct Task {
+        function<void()> fn;
+        steady_clock::time_point queued;
+    };
+
+    string name;
+    list<Worker> workers;
+    queue<Task> tasks;
     mutex queue_mutex;
     condition_variable cv;
     bool stop = false;
+    size_t live = 0;     // worker ที่ยังไม่ถูกสั่งเลิก
+    size_t retire = 0;   // จำนวน worker ที่ต้องเลิกเมื่อว่าง
+    vector<int> cpus;    // CPU affinity ของ worker (ว่าง = ไม่กำหนด)
+    atomic<int> busy{0};
+    long long wait_sum_us = 0;  // เวลารอในคิวรวมของงานที่เริ่มตั้งแต่ stats() ครั้งก่อน (ป้องกันด้วย queue_mutex)
+    size_t wait_count = 0;
+
+    void spawn() {
+        workers.emplace_back();
+        Worker *self = &workers.back();
+        self->th = thread([this, self] {
+            while (true) {
+                Task task;
+                {
+                    unique_lock<mutex> lock(queue_mutex);
+                    cv.wait(lock, [this] { return stop || retire > 0 || !tasks.empty(); });
+                    if (retire > 0 && !stop) {
+                        --retire;
+                        self->done = true;
+                        return;
+                    }
+                    if (stop && tasks.empty()) return;
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                    wait_sum_us += duration_cast<microseconds>(steady_clock::now() - task.queued).count();
+                    ++wait_count;
+                }
+                ++busy;
+                try {
+                    task.fn();
+                } catch (const exception &e) {
+                    cerr << "[ThreadPool] Task error: " << e.what() << endl;
+                } catch (...) {
+                    cerr << "[ThreadPool] Unknown error in task.\n";
+                }
+                --busy;
+            }
+        });
+
+        if (!cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus) CPU_SET(cpu, &set);
+            int rc = pthread_setaffinity_np(self->th.native_handle(), sizeof(set), &set);
+            if (rc != 0) cerr << "[ThreadPool][" << name << "] Failed to set CPU affinity: " << strerror(rc) << endl;
+        }
+        ++live;
+    }
+
+    // join worker ที่เลิกไปแล้ว (เรียกโดยไม่ถือ queue_mutex)
+    void reap() {
+        list<Worker> finished;
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            for (auto it = workers.begin(); it != workers.end();) {
+                auto cur = it++;
+                if (cur->done) finished.splice(finished.end(), workers, cur);
+            }
+        }
+        for (auto &w : finished)
+            if (w.th.joinable()) w.th.join();
+    }
 
 public:
-    ThreadPool(size_t threads = thread::hardware_concurrency()) {
+    struct Stats {
+        size_t workers;
+        size_t backlog;
+        int busy;
+        long long wait_us; // เวลารอในคิวเฉลี่ยของงานที่เริ่มในช่วงตั้งแต่ stats() ครั้งก่อน
+    };
+
+    ThreadPool(size_t threads = thread::hardware_concurrency(), string pool_name = "pool", vector<int> affinity = {})
+        : name(std::move(pool_name)), cpus(std::move(affinity)) {
         if (threads == 0)
             threads = 2;
         try {
-            for (size_t i = 0; i < threads; ++i) {
-                workers.emplace_back([this] {
-                    while (true) {
-                        function<void()> task;
-                        {
-                            unique_lock<mutex> lock(queue_mutex);
-                            cv.wait(lock, [this] { return stop || !tasks.empty(); });
-                            if (stop && tasks.empty()) return;
-                            task = std::move(tasks.front());
-                            tasks.pop();
-                        }
-                        try {
-                            task();
-                        } catch (const exception &e) {
-                            cerr << "[ThreadPool] Task error: " << e.what() << endl;
-                        } catch (...) {
-                            cerr << "[ThreadPool] Unknown error in task.\n";
-                        }
-                    }
-                });
-            }
+            unique_lock<mutex> lock(queue_mutex);
+            for (size_t i = 0; i < threads; ++i) spawn();
         } catch (const exception &e) {
             cerr << "[ThreadPool] Failed to create threads: " << e.what() << endl;
             stop = true;
@@ -74,24 +183,662 @@ public:
 
     template <class F>
     void enqueue(F &&f) {
-        if (stop) return;
         {
             unique_lock<mutex> lock(queue_mutex);
-            tasks.emplace(std::forward<F>(f));
+            if (stop) return;
+            tasks.push(Task{std::forward<F>(f), steady_clock::now()});
         }
         cv.notify_one();
     }
 
-    ~ThreadPool() {
+    // เพิ่ม/ลดจำนวน worker; worker ที่ถูกลดจะเลิกหลังทำงานปัจจุบันเสร็จ
+    void resize(size_t target) {
+        if (target == 0) target = 1;
+        reap();
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            if (stop) return;
+            try {
+                while (live < target) {
+                    if (retire > 0) {
+                        --retire; // ยกเลิกคำสั่งเลิกที่ยังไม่มีใครรับไป
+                        ++live;
+                    } else {
+                        spawn();
+                    }
+                }
+            } catch (const exception &e) {
+                cerr << "[ThreadPool][" << name << "] Failed to grow: " << e.what() << endl;
+            }
+            while (live > target) {
+                --live;
+                ++retire;
+            }
+        }
+        cv.notify_all();
+    }
+
+    // อ่านแล้วเริ่มช่วงวัดเวลารอใหม่
+    Stats stats() {
+        unique_lock<mutex> lock(queue_mutex);
+        long long wait_us = wait_count ? wait_sum_us / (long long)wait_count : 0;
+        wait_sum_us = 0;
+        wait_count = 0;
+        return Stats{live, tasks.size(), busy.load(), wait_us};
+    }
+
+    const string &poolName() const { return name; }
+
+    // หยุดรับงานใหม่ ทำงานที่ค้างในคิวให้หมด แล้ว join worker ทุกตัว (เรียกซ้ำได้)
+    // เจ้าของ pool ต้องเรียกก่อนทำลายสิ่งที่งานในคิวอ้างถึง
+    void shutdown() {
         {
             unique_lock<mutex> lock(queue_mutex);
             stop = true;
         }
         cv.notify_all();
         for (auto &w : workers) {
-            if (w.joinable()) w.join();
+            if (w.th.joinable()) w.th.join();
+        }
+    }
+
+    ~ThreadPool() {
+        shutdown();
+    }
+};
+
+// EventLoop: reactor แบบ epoll รวม fd หลายแหล่ง (POSIX mq, timerfd, eventfd, socket) ไว้ใน thread เดียว
+// add/modify/remove/addTimer ต้องเรียกจาก loop thread หรือก่อน run() เท่านั้น, thread อื่นให้ใช้ post()
+class EventLoop {
+public:
+    using Handler = function<void(uint32_t)>;
+
+private:
+    int epfd = -1;
+    int wakefd = -1;
+    atomic<bool> stopping{false};
+    unordered_map<int, shared_ptr<Handler>> handlers;
+    vector<int> timers;
+    mutex posted_mtx;
+    vector<function<void()>> posted;
+
+    void drainPosted() {
+        uint64_t n;
+        while (read(wakefd, &n, sizeof(n)) > 0) {}
+
+        vector<function<void()>> batch;
+        {
+            lock_guard<mutex> lock(posted_mtx);
+            batch.swap(posted);
+        }
+        for (auto &fn : batch) {
+            try {
+                fn();
+            } catch (const exception &e) {
+                cerr << "[EventLoop] Posted task error: " << e.what() << endl;
+            }
+        }
+    }
+
+public:
+    EventLoop() {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd == -1)
+            throw runtime_error(string("epoll_create1 failed: ") + strerror(errno));
+        wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakefd == -1) {
+            close(epfd);
+            throw runtime_error(string("eventfd failed: ") + strerror(errno));
+        }
+        add(wakefd, EPOLLIN, [this](uint32_t) { drainPosted(); });
+    }
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    bool add(int fd, uint32_t events, Handler handler) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            perror("[EventLoop] epoll_ctl ADD failed");
+            return false;
+        }
+        handlers[fd] = make_shared<Handler>(std::move(handler));
+        return true;
+    }
+
+    bool modify(int fd, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+            perror("[EventLoop] epoll_ctl MOD failed");
+            return false;
+        }
+        return true;
+    }
+
+    void remove(int fd) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        handlers.erase(fd);
+    }
+
+    // timer แบบวนซ้ำทุก interval คืนค่า fd ของ timerfd (หรือ -1 ถ้าสร้างไม่สำเร็จ)
+    int addTimer(milliseconds interval, function<void()> callback) {
+        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (tfd == -1) {
+            perror("[EventLoop] timerfd_create failed");
+            return -1;
+        }
+        itimerspec spec{};
+        spec.it_interval.tv_sec = interval.count() / 1000;
+        spec.it_interval.tv_nsec = (interval.count() % 1000) * 1000000L;
+        spec.it_value = spec.it_interval;
+        if (timerfd_settime(tfd, 0, &spec, nullptr) == -1 ||
+            !add(tfd, EPOLLIN, [tfd, callback](uint32_t) {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) > 0) callback();
+            })) {
+            perror("[EventLoop] timer setup failed");
+            close(tfd);
+            return -1;
+        }
+        timers.push_back(tfd);
+        return tfd;
+    }
+
+    // ส่งงานมารันใน loop thread (thread-safe) ใช้ eventfd ปลุก epoll_wait
+    void post(function<void()> fn) {
+        {
+            lock_guard<mutex> lock(posted_mtx);
+            posted.push_back(std::move(fn));
+        }
+        uint64_t one = 1;
+        if (write(wakefd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+            perror("[EventLoop] eventfd write failed");
+    }
+
+    void run() {
+        epoll_event events[64];
+        while (!stopping.load()) {
+            int n = epoll_wait(epfd, events, 64, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("[EventLoop] epoll_wait failed");
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                auto it = handlers.find(events[i].data.fd);
+                if (it == handlers.end()) continue; // ถูก remove ไปแล้วใน batch นี้
+                shared_ptr<Handler> handler = it->second;
+                try {
+                    (*handler)(events[i].events);
+                } catch (const exception &e) {
+                    cerr << "[EventLoop] Handler error: " << e.what() << endl;
+                }
+            }
         }
     }
+
+    void stop() {
+        stopping = true;
+        uint64_t one = 1;
+        if (write(wakefd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+            perror("[EventLoop] eventfd write failed");
+    }
+
+    ~EventLoop() {
+        for (int tfd : timers) close(tfd);
+        if (wakefd != -1) close(wakefd);
+        if (epfd != -1) close(epfd);
+    }
+};
+
+// SearchIndex: inverted index ของข้อความในแต่ละห้อง สร้างแบบ incremental ใน thread แยก (ไม่อยู่บน hot path ของ say)
+// posting list เก็บเลขข้อความแบบ delta + varint; คำภาษาอังกฤษ/ตัวเลขเป็น 1 term ต่อคำ (ตัวพิมพ์เล็ก)
+// ข้อความภาษาไทยไม่มีช่องว่างระหว่างคำ จึงใช้ bigram ของ code point แล้วตรวจ substring ซ้ำตอนค้นหา
+// แต่ละห้องแบ่งเป็น segment ละ SEGMENT_DOCS ข้อความ เกินจำนวนที่เก็บได้จะทิ้ง segment เก่าสุดทั้งก้อน
+class SearchIndex {
+public:
+    struct Hit {
+        int sender;
+        long long timestamp;
+        string text;
+    };
+
+    struct Result {
+        size_t total = 0;
+        bool approximate = false; // total นับรวมข้อความที่ยังไม่ได้ตรวจ substring (เป็นขอบบน)
+        vector<Hit> hits;
+    };
+
+private:
+    struct PostingList {
+        string bytes;       // delta ของ doc id เข้ารหัส varint ต่อกัน
+        uint32_t last = 0;
+        uint32_t count = 0;
+
+        void add(uint32_t doc) {
+            if (count > 0 && doc == last) return; // term ซ้ำในข้อความเดียวกัน
+            uint32_t delta = count == 0 ? doc : doc - last;
+            while (delta >= 0x80) {
+                bytes.push_back((char)(delta | 0x80));
+                delta >>= 7;
+            }
+            bytes.push_back((char)delta);
+            last = doc;
+            ++count;
+        }
+
+        vector<uint32_t> decode() const {
+            vector<uint32_t> docs;
+            docs.reserve(count);
+            uint32_t doc = 0, value = 0;
+            int shift = 0;
+            for (unsigned char b : bytes) {
+                value |= (uint32_t)(b & 0x7f) << shift;
+                if (b & 0x80) {
+                    shift += 7;
+                    continue;
+                }
+                doc = docs.empty() ? value : doc + value;
+                docs.push_back(doc);
+                value = 0;
+                shift = 0;
+            }
+            return docs;
+        }
+    };
+
+    struct Segment {
+        vector<Hit> docs; // doc id = ตำแหน่งใน segment
+        unordered_map<string, PostingList> postings;
+    };
+
+    struct RoomIndex {
+        shared_mutex mtx;
+        deque<Segment> segments; // เก่า -> ใหม่
+    };
+
+    struct Job {
+        string room;
+        Hit hit;
+    };
+
+    size_t max_segments; // 0 = ไม่จำกัด
+    mutex rooms_mtx;
+    unordered_map<string, unique_ptr<RoomIndex>> rooms;
+
+    mutex jobs_mtx;
+    condition_variable jobs_cv;
+    vector<Job> jobs;
+    bool stopping = false;
+    thread worker;
+
+    static size_t utf8Length(unsigned char lead) {
+        if (lead < 0x80) return 1;
+        if ((lead >> 5) == 0x6) return 2;
+        if ((lead >> 4) == 0xe) return 3;
+        if ((lead >> 3) == 0x1e) return 4;
+        return 1; // ไบต์เสีย นับเป็นตัวเดียว
+    }
+
+    static string lowerAscii(string text) {
+        for (auto &c : text)
+            if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        return text;
+    }
+
+    // แยก term: ASCII ตัวอักษร/ตัวเลข -> คำ, code point ที่ไม่ใช่ ASCII ติดกัน -> bigram
+    // ช่วงที่มี code point เดียวจะได้ term ตัวเดียว (ใช้เฉพาะตอน index, query จะข้ามเพราะสั้นเกินไป)
+    // runs (ถ้ามี) รับช่วงที่ยาว 3 code point ขึ้นไป ซึ่ง bigram ตรงกันครบยังไม่พอยืนยันว่าอยู่ติดกัน
+    static void tokenize(const string &text, vector<string> &terms, bool keepSingles, vector<string> *runs = nullptr) {
+        string word;
+        vector<string> run;
+        auto flushRun = [&]() {
+            if (run.size() == 1 && keepSingles) terms.push_back(run[0]);
+            for (size_t i = 0; i + 1 < run.size(); ++i) terms.push_back(run[i] + run[i + 1]);
+            if (runs && run.size() >= 3) {
+                string joined;
+                for (const auto &cp : run) joined += cp;
+                runs->push_back(joined);
+            }
+            run.clear();
+        };
+        auto flushWord = [&]() {
+            if (!word.empty()) terms.push_back(word);
+            word.clear();
+        };
+
+        for (size_t i = 0; i < text.size();) {
+            unsigned char c = (unsigned char)text[i];
+            size_t len = min(utf8Length(c), text.size() - i);
+            if (len > 1) {
+                flushWord();
+                run.push_back(text.substr(i, len));
+            } else {
+                flushRun();
+                if (isalnum(c))
+                    word.push_back((char)tolower(c));
+                else
+                    flushWord();
+            }
+            i += len;
+        }
+        flushWord();
+        flushRun();
+    }
+
+    RoomIndex *roomIndex(const string &room, bool create) {
+        lock_guard<mutex> lock(rooms_mtx);
+        auto it = rooms.find(room);
+        if (it != rooms.end()) return it->second.get();
+        if (!create) return nullptr;
+        return (rooms[room] = make_unique<RoomIndex>()).get();
+    }
+
+    void indexJob(Job &job) {
+        vector<string> terms;
+        tokenize(job.hit.text, terms, true);
+
+        RoomIndex *idx = roomIndex(job.room, true);
+        unique_lock<shared_mutex> lock(idx->mtx);
+        if (idx->segments.empty() || idx->segments.back().docs.size() >= SEGMENT_DOCS) {
+            idx->segments.emplace_back();
+            if (max_segments > 0 && idx->segments.size() > max_segments) idx->segments.pop_front();
+        }
+        Segment &seg = idx->segments.back();
+        uint32_t doc = (uint32_t)seg.docs.size();
+        seg.docs.push_back(std::move(job.hit));
+        for (const auto &term : terms) seg.postings[term].add(doc);
+    }
+
+    // doc id ใน segment ที่มีทุก term (เรียงจากเก่าไปใหม่)
+    static void intersect(const Segment &seg, const vector<string> &terms, vector<uint32_t> &matched) {
+        matched.clear();
+        vector<const PostingList *> lists;
+        for (const auto &term : terms) {
+            auto it = seg.postings.find(term);
+            if (it == seg.postings.end()) return; // term ใดไม่มีเลย ผลลัพธ์ว่าง
+            lists.push_back(&it->second);
+        }
+        // เริ่มจาก list ที่สั้นที่สุดเพื่อให้ผล intersect เล็กเร็วที่สุด
+        sort(lists.begin(), lists.end(), [](const PostingList *a, const PostingList *b) { return a->count < b->count; });
+
+        matched = lists[0]->decode();
+        for (size_t i = 1; i < lists.size() && !matched.empty(); ++i) {
+            vector<uint32_t> other = lists[i]->decode(), merged;
+            set_intersection(matched.begin(), matched.end(), other.begin(), other.end(), back_inserter(merged));
+            matched.swap(merged);
+        }
+    }
+
+    static bool containsAll(const string &text, const vector<string> &runs) {
+        for (const auto &r : runs)
+            if (text.find(r) == string::npos) return false;
+        return true;
+    }
+
+    void run() {
+        while (true) {
+            vector<Job> batch;
+            {
+                unique_lock<mutex> lock(jobs_mtx);
+                jobs_cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty()) return;
+                batch.swap(jobs);
+            }
+            for (auto &job : batch) {
+                try {
+                    indexJob(job);
+                } catch (const exception &e) {
+                    cerr << "[SearchIndex] Index error: " << e.what() << endl;
+                }
+            }
+        }
+    }
+
+public:
+    static constexpr size_t PAGE_SIZE = 5;
+    static constexpr size_t SEGMENT_DOCS = 4096;
+
+    // retention = จำนวนข้อความล่าสุดต่อห้องที่รับประกันว่าค้นได้ (0 = ไม่จำกัด)
+    explicit SearchIndex(size_t retention = 0)
+        : max_segments(retention == 0 ? 0 : (retention + SEGMENT_DOCS - 1) / SEGMENT_DOCS + 1), worker([this] { run(); }) {}
+
+    SearchIndex(const SearchIndex &) = delete;
+    SearchIndex &operator=(const SearchIndex &) = delete;
+
+    // เรียกจาก hot path: แค่ต่อคิว งาน index จริงทำใน worker thread
+    void submit(const string &room, int sender, long long timestamp, const string &text) {
+        {
+            lock_guard<mutex> lock(jobs_mtx);
+            if (stopping) return;
+            jobs.push_back(Job{room, Hit{sender, timestamp, text}});
+        }
+        jobs_cv.notify_one();
+    }
+
+    // ค้นหาข้อความที่มีทุก term (AND) เรียงจากใหม่ไปเก่า page เริ่มที่ 1
+    // ถ้า query มีช่วงภาษาไทยที่ต้องตรวจ substring จะตรวจเฉพาะเท่าที่ต้องใช้เติมหน้านั้น ที่เหลือนับเป็นค่าประมาณ
+    // คืน false ถ้า query ไม่มี term ที่ใช้ค้นได้
+    bool search(const string &room, const string &query, size_t page, Result &result) {
+        vector<string> terms, runs;
+        tokenize(query, terms, false, &runs);
+        sort(terms.begin(), terms.end());
+        terms.erase(unique(terms.begin(), terms.end()), terms.end());
+        if (terms.empty()) return false;
+
+        RoomIndex *idx = roomIndex(room, false);
+        if (!idx) return true;
+
+        shared_lock<shared_mutex> lock(idx->mtx);
+        size_t begin = (page - 1) * PAGE_SIZE, end = begin + PAGE_SIZE;
+        vector<uint32_t> matched;
+        for (auto seg = idx->segments.rbegin(); seg != idx->segments.rend(); ++seg) {
+            intersect(*seg, terms, matched);
+            for (auto it = matched.rbegin(); it != matched.rend(); ++it) {
+                if (!runs.empty()) {
+                    if (result.total >= end) { // หน้าเต็มแล้ว ไม่ต้องตรวจที่เหลือ
+                        result.approximate = true;
+                        result.total += (size_t)(matched.rend() - it);
+                        break;
+                    }
+                    if (!containsAll(seg->docs[*it].text, runs)) continue;
+                }
+                if (result.total >= begin && result.total < end) result.hits.push_back(seg->docs[*it]);
+                ++result.total;
+            }
+        }
+        return true;
+    }
+
+    ~SearchIndex() {
+        {
+            lock_guard<mutex> lock(jobs_mtx);
+            stopping = true;
+        }
+        jobs_cv.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+};
+
+// MessageFilter: stage หนึ่งใน pipeline ที่ตรวจข้อความ say/dm ก่อน fan-out (ทำครั้งเดียวต่อข้อความ ไม่ใช่ต่อผู้รับ)
+class MessageFilter {
+public:
+    virtual ~MessageFilter() = default;
+    virtual const char *name() const = 0;
+    // คืน false ถ้าข้อความไม่ผ่าน พร้อมเหตุผลใน reason
+    virtual bool allow(const string &text, string &reason) const = 0;
+};
+
+// ลำดับ stage ถูกกำหนดตอนเริ่ม server; stage แต่ละตัว reload ข้อมูลของตัวเองได้โดยไม่ต้องหยุด pipeline
+class FilterPipeline {
+    vector<shared_ptr<MessageFilter>> stages;
+
+public:
+    void add(shared_ptr<MessageFilter> stage) { stages.push_back(std::move(stage)); }
+
+    bool empty() const { return stages.empty(); }
+
+    bool allow(const string &text, string &reason) const {
+        for (const auto &stage : stages)
+            if (!stage->allow(text, reason)) {
+                reason = string(stage->name()) + ": " + reason;
+                return false;
+            }
+        return true;
+    }
+};
+
+// AhoCorasick: DFA สำหรับค้นหลาย pattern พร้อมกัน ต้นทุนต่อไบต์เป็นการเปิดตาราง 1 ครั้งไม่ว่าจะมีกี่ pattern
+// ไบต์ถูกยุบเป็น class (ไบต์ที่ไม่อยู่ใน pattern ใดรวมเป็น class 0) เพื่อให้ตารางไม่ต้องกว้าง 256 ช่อง
+// ตัวอักษร ASCII ไม่สนตัวพิมพ์ใหญ่/เล็ก
+class AhoCorasick {
+    array<uint16_t, 256> byte_class{};
+    size_t classes = 1;
+    vector<int32_t> next;   // next[state * classes + class]
+    vector<int32_t> match;  // index ของ pattern ที่จบที่ state นี้ (รวมผ่าน failure link), -1 = ไม่มี
+    vector<string> patterns;
+
+    static unsigned char fold(unsigned char c) { return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c; }
+
+    int32_t addState() {
+        next.resize(next.size() + classes, -1);
+        match.push_back(-1);
+        return (int32_t)match.size() - 1;
+    }
+
+public:
+    explicit AhoCorasick(vector<string> list) : patterns(std::move(list)) {
+        for (auto &p : patterns)
+            for (auto &c : p) c = (char)fold((unsigned char)c);
+
+        for (const auto &p : patterns)
+            for (unsigned char c : p)
+                if (byte_class[c] == 0) byte_class[c] = (uint16_t)classes++;
+        for (int c = 'A'; c <= 'Z'; ++c) byte_class[c] = byte_class[fold((unsigned char)c)];
+
+        addState(); // root
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            if (patterns[i].empty()) continue;
+            int32_t state = 0;
+            for (unsigned char c : patterns[i]) {
+                size_t slot = (size_t)state * classes + byte_class[c];
+                if (next[slot] == -1) {
+                    int32_t created = addState();
+                    next[slot] = created; // addState อาจย้าย buffer จึงเขียนผ่าน index หลังสร้าง
+                }
+                state = next[slot];
+            }
+            if (match[state] == -1) match[state] = (int32_t)i;
+        }
+
+        // BFS สร้าง failure link แล้วเติม transition ที่ขาดให้เป็น DFA สมบูรณ์
+        vector<int32_t> fail(match.size(), 0);
+        queue<int32_t> bfs;
+        for (size_t c = 0; c < classes; ++c) {
+            int32_t &to = next[c];
+            if (to == -1) {
+                to = 0;
+            } else {
+                fail[to] = 0;
+                bfs.push(to);
+            }
+        }
+        while (!bfs.empty()) {
+            int32_t state = bfs.front();
+            bfs.pop();
+            if (match[state] == -1) match[state] = match[fail[state]];
+            for (size_t c = 0; c < classes; ++c) {
+                int32_t &to = next[(size_t)state * classes + c];
+                int32_t via_fail = next[(size_t)fail[state] * classes + c];
+                if (to == -1) {
+                    to = via_fail;
+                } else {
+                    fail[to] = via_fail;
+                    bfs.push(to);
+                }
+            }
+        }
+    }
+
+    size_t size() const { return patterns.size(); }
+    size_t states() const { return match.size(); }
+
+    // คืน index ของ pattern แรกที่พบ หรือ -1
+    int find(const string &text) const {
+        int32_t state = 0;
+        for (unsigned char c : text) {
+            state = next[(size_t)state * classes + byte_class[c]];
+            if (match[state] != -1) return match[state];
+        }
+        return -1;
+    }
+
+    const string &pattern(int i) const { return patterns[(size_t)i]; }
+};
+
+// ModerationFilter: บล็อกข้อความที่มีคำ/URL ต้องห้ามจากไฟล์ (บรรทัดละ 1 pattern, '#' นำหน้า = comment)
+// reload() สร้าง automaton ใหม่ข้างนอกแล้วสลับ pointer แบบ atomic ข้อความที่กำลังตรวจอยู่ใช้ตัวเก่าจนจบ
+class ModerationFilter : public MessageFilter {
+    string path;
+    shared_ptr<const AhoCorasick> matcher;
+    timespec loaded_mtime{};
+    off_t loaded_size = -1; // -1 = ยังโหลดไม่สำเร็จ (เช่นไฟล์ยังไม่มี) ให้ลองใหม่ทันทีที่ stat ได้
+
+public:
+    explicit ModerationFilter(string file) : path(std::move(file)) {
+        if (!reload()) matcher = make_shared<const AhoCorasick>(vector<string>{});
+    }
+
+    const char *name() const override { return "moderation"; }
+
+    bool allow(const string &text, string &reason) const override {
+        shared_ptr<const AhoCorasick> current = atomic_load(&matcher);
+        int hit = current->find(text);
+        if (hit < 0) return true;
+        reason = "banned term '" + current->pattern(hit) + "'";
+        return false;
+    }
+
+    // stat ก่อนอ่าน: ถ้าไฟล์ถูกแก้ระหว่างอ่าน รอบถัดไปจะเห็น stat ใหม่แล้วโหลดซ้ำ
+    bool reload() {
+        struct stat st;
+        ifstream in(path);
+        if (stat(path.c_str(), &st) == -1 || !in) {
+            cerr << "[Filter] Cannot open pattern file: " << path << endl;
+            loaded_size = -1;
+            return false;
+        }
+        vector<string> list;
+        string line;
+        while (getline(in, line)) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            list.push_back(line);
+        }
+
+        auto started = steady_clock::now();
+        auto built = make_shared<const AhoCorasick>(std::move(list));
+        double took_ms = duration_cast<microseconds>(steady_clock::now() - started).count() / 1000.0;
+        atomic_store(&matcher, built);
+        loaded_mtime = st.st_mtim;
+        loaded_size = st.st_size;
+        cout << "[Filter] Loaded " << built->size() << " pattern(s) from " << path << " (" << built->states()
+             << " states, " << took_ms << " ms)" << endl;
+        return true;
+    }
+
+    // เรียกเป็นระยะจาก timer: reload เมื่อ mtime หรือขนาดไฟล์ต่างจากที่โหลดไว้ หรือครั้งก่อนโหลดไม่สำเร็จ
+    void reloadIfChanged() {
+        struct stat st;
+        if (stat(path.c_str(), &st) == -1) return;
+        if (st.st_mtim.tv_sec == loaded_mtime.tv_sec && st.st_mtim.tv_nsec == loaded_mtime.tv_nsec && st.st_size == loaded_size)
+            return;
+        reload();
+    }
 };
 
 // คลาส Client
@@ -128,15 +875,139 @@ public:
     }
 };
 
+// SubscriptionTrie: subscription แบบ wildcard บนชื่อห้องแบบลำดับชั้นที่คั่นด้วยจุด (เช่น team.dev.backend)
+// '*' ตรงกับ 1 ระดับพอดี, '#' ตรงกับ 0 ระดับขึ้นไป (team.* ตรงกับ team.dev, team.# ตรงกับ team และ team.dev.backend)
+// Room เรียก match() เฉพาะตอนสร้าง recipient cache ใหม่ ไม่ใช่ทุกข้อความ
+class SubscriptionTrie {
+    struct Node {
+        unordered_map<string, unique_ptr<Node>> children; // ระดับถัดไป รวมถึง "*" และ "#"
+        set<Client *> subscribers;                        // client ที่ pattern จบที่ node นี้
+    };
+
+    shared_mutex mtx;
+    Node root;
+    atomic<uint64_t> gen{1};
+
+    static vector<string> split(const string &name) {
+        vector<string> segments;
+        size_t start = 0;
+        while (true) {
+            size_t dot = name.find('.', start);
+            segments.push_back(name.substr(start, dot == string::npos ? string::npos : dot - start));
+            if (dot == string::npos) break;
+            start = dot + 1;
+        }
+        return segments;
+    }
+
+    static void collect(const Node &node, const vector<string> &segments, size_t i, vector<Client *> &out) {
+        auto hash = node.children.find("#");
+        if (hash != node.children.end())
+            for (size_t k = i; k <= segments.size(); ++k) collect(*hash->second, segments, k, out);
+
+        if (i == segments.size()) {
+            out.insert(out.end(), node.subscribers.begin(), node.subscribers.end());
+            return;
+        }
+        auto exact = node.children.find(segments[i]);
+        if (exact != node.children.end()) collect(*exact->second, segments, i + 1, out);
+        auto star = node.children.find("*");
+        if (star != node.children.end()) collect(*star->second, segments, i + 1, out);
+    }
+
+    // ลบ node ที่ไม่มีทั้ง subscriber และลูกแล้ว คืน true ถ้า node นี้ว่าง
+    static bool prune(Node &node, const vector<string> &segments, size_t i, Client *client, bool &removed) {
+        if (i == segments.size()) {
+            removed = node.subscribers.erase(client) > 0;
+        } else {
+            auto it = node.children.find(segments[i]);
+            if (it == node.children.end()) return false;
+            if (prune(*it->second, segments, i + 1, client, removed)) node.children.erase(it);
+        }
+        return node.subscribers.empty() && node.children.empty();
+    }
+
+public:
+    // ชื่อห้องจริงต้องไม่ว่าง ไม่มีระดับว่าง และไม่มี wildcard
+    static bool isValidName(const string &name, bool allowWildcards) {
+        if (name.empty()) return false;
+        for (const auto &seg : split(name)) {
+            if (seg.empty()) return false;
+            bool wildcard = seg == "*" || seg == "#";
+            if (wildcard && !allowWildcards) return false;
+            if (!wildcard && seg.find_first_of("*#") != string::npos) return false;
+        }
+        return true;
+    }
+
+    // เลข generation เปลี่ยนทุกครั้งที่ subscription เปลี่ยน ใช้ตรวจว่า cache ของห้องยังใช้ได้หรือไม่
+    uint64_t generation() const { return gen.load(); }
+
+    bool subscribe(const string &pattern, Client *client) {
+        vector<string> segments = split(pattern);
+        unique_lock<shared_mutex> lock(mtx);
+        Node *node = &root;
+        for (const auto &seg : segments) {
+            auto &child = node->children[seg];
+            if (!child) child = make_unique<Node>();
+            node = child.get();
+        }
+        bool added = node->subscribers.insert(client).second;
+        if (added) ++gen;
+        return added;
+    }
+
+    bool unsubscribe(const string &pattern, Client *client) {
+        vector<string> segments = split(pattern);
+        unique_lock<shared_mutex> lock(mtx);
+        bool removed = false;
+        prune(root, segments, 0, client, removed);
+        if (removed) ++gen;
+        return removed;
+    }
+
+    vector<Client *> match(const string &room) {
+        vector<Client *> out;
+        vector<string> segments = split(room);
+        shared_lock<shared_mutex> lock(mtx);
+        collect(root, segments, 0, out);
+        return out;
+    }
+};
+
 // คลาส Room
 class Room {
 public:
     string room_name;
     vector<Client *> members;
     mutex members_mtx;
+    SearchIndex *index = nullptr;              // Router กำหนดให้ตอนสร้างห้อง
+    SubscriptionTrie *subscriptions = nullptr; // Router กำหนดให้ตอนสร้างห้อง
+
+    // ผู้รับของห้องนี้ (members + wildcard subscribers ไม่ซ้ำกัน) สร้างใหม่เมื่อสมาชิกหรือ subscription เปลี่ยน
+    shared_ptr<const vector<Client *>> recipients;
+    uint64_t recipients_gen = 0;
 
     explicit Room(string n) : room_name(std::move(n)) {}
 
+    shared_ptr<const vector<Client *>> recipientsSnapshot() {
+        lock_guard<mutex> lock(members_mtx);
+        uint64_t gen = subscriptions ? subscriptions->generation() : 0;
+        if (recipients && recipients_gen == gen) return recipients;
+
+        vector<Client *> all(members.begin(), members.end());
+        if (subscriptions) {
+            vector<Client *> matched = subscriptions->match(room_name);
+            all.insert(all.end(), matched.begin(), matched.end());
+        }
+        sort(all.begin(), all.end());
+        all.erase(unique(all.begin(), all.end()), all.end());
+
+        recipients = make_shared<const vector<Client *>>(std::move(all));
+        recipients_gen = gen;
+        return recipients;
+    }
+
     void join(Client *client) {
         if (!client) {
             cerr << "[Room][" << room_name << "] Null client ignored.\n";
@@ -149,15 +1020,22 @@ public:
             return;
         }
         members.push_back(client);
+        recipients.reset();
         cout << "[Join][" << client->name << "][To][" << room_name << "]\n";
     }
 
+    size_t size() {
+        lock_guard<mutex> lock(members_mtx);
+        return members.size();
+    }
+
     bool leave(Client *client) {
         if (!client) return false;
         lock_guard<mutex> lock(members_mtx);
         for (auto it = members.begin(); it != members.end(); ++it) {
             if ((*it)->id == client->id) {
                 members.erase(it);
+                recipients.reset();
                 cout << "[Left][" << client->name << "][From][" << room_name << "]\n";
                 return true;
             }
@@ -176,12 +1054,15 @@ public:
         // NEW Server Console Output: แสดง SenderID และ Room Name
         cout << "[BROADCAST][From:" << senderID << "][To:" << room_name << "]: " << text << endl; 
 
-        lock_guard<mutex> lock(members_mtx);
+        if (index) index->submit(room_name, senderID, timestamp, text);
+
+        // ใช้ recipient cache ไม่ต้อง match pattern หรือถือ lock ระหว่างส่งงานเข้า pool
+        shared_ptr<const vector<Client *>> targets = recipientsSnapshot();
         
         // คำนำหน้าสำหรับ BoardCast (SAY) ให้แสดง SenderID และ RoomName**
         const string broadcast_text = "[Recieved Message from " + to_string(senderID) + " in room " + this->room_name + "]: " + text;
 
-        for (auto c : members) {
+        for (auto c : *targets) {
             if (!c) continue;
             pool.enqueue([=]() {
                 msg_buffer msg{};
@@ -198,12 +1079,647 @@ public:
     }
 };
 
+// ข้อความ say ที่ส่งข้าม router ใน federation
+struct FederatedSay {
+    string room;
+    string origin; // node ที่รับข้อความนี้จาก client
+    int sender;
+    long long timestamp;
+    string text;
+};
+
+// เฟรมระหว่าง router: [u32 ความยาว][u8 ชนิด][payload] แบบ big-endian, ความยาวนับรวมไบต์ชนิด
+enum FrameType : uint8_t { FRAME_HELLO = 1, FRAME_SUB = 2, FRAME_UNSUB = 3, FRAME_SAY = 4 };
+
+struct FrameWriter {
+    string buf;
+
+    void u8(uint8_t v) { buf.push_back((char)v); }
+    void u16(uint16_t v) { u8(v >> 8); u8(v & 0xff); }
+    void u32(uint32_t v) { u16(v >> 16); u16(v & 0xffff); }
+    void u64(uint64_t v) { u32(v >> 32); u32(v & 0xffffffffu); }
+    void str(const string &v) {
+        size_t n = min<size_t>(v.size(), 0xffff);
+        u16((uint16_t)n);
+        buf.append(v, 0, n);
+    }
+
+    static string frame(FrameType type, const string &payload) {
+        FrameWriter w;
+        w.u32((uint32_t)payload.size() + 1);
+        w.u8(type);
+        w.buf += payload;
+        return w.buf;
+    }
+};
+
+struct FrameReader {
+    const char *p;
+    size_t left;
+    bool ok = true;
+
+    FrameReader(const char *data, size_t len) : p(data), left(len) {}
+
+    uint8_t u8() {
+        if (left == 0) {
+            ok = false;
+            return 0;
+        }
+        --left;
+        return (uint8_t)*p++;
+    }
+    uint16_t u16() { uint16_t hi = u8(); return (uint16_t)(hi << 8 | u8()); }
+    uint32_t u32() { uint32_t hi = u16(); return hi << 16 | u16(); }
+    uint64_t u64() { uint64_t hi = u32(); return hi << 32 | u32(); }
+    string str() {
+        uint16_t n = u16();
+        if (!ok || n > left) {
+            ok = false;
+            return "";
+        }
+        string v(p, n);
+        p += n;
+        left -= n;
+        return v;
+    }
+};
+
+// Federation: เชื่อม router หลายตัวผ่าน TCP ให้ห้องเดียวกันกระจายข้ามเครื่องได้
+// - ทุกห้องมี home router (rendezvous hash ของชื่อห้องกับชื่อ node) ทุก node จึงคำนวณ home ได้ตรงกันโดยไม่ต้องคุยกัน
+// - router ที่มีสมาชิกของห้องแจ้ง SUB/UNSUB ไปยัง home, home เก็บว่า peer ไหนสนใจห้องไหน
+// - say ถูกส่งไป home ครั้งเดียว แล้ว home ส่งต่อ peer ละครั้งเดียว (ไม่ใช่ต่อสมาชิก) ปลายทางกระจายให้สมาชิกในเครื่องเอง
+// socket ทั้งหมดอยู่ใน EventLoop ของตัวเอง; ขาออกใช้การเชื่อมต่อที่เราเปิดเอง ขาเข้าใช้การเชื่อมต่อที่ peer เปิดมา
+class Federation {
+public:
+    using SayHandler = function<void(const FederatedSay &)>;
+
+private:
+    struct Peer {
+        string node;
+        string host;
+        string port;
+        int fd = -1;
+        bool connected = false;
+        bool want_write = false;
+        string wbuf;                 // loop thread เท่านั้น
+
+        mutex out_mtx;
+        string pending;              // เฟรมจาก thread อื่นที่รอ flush รวมเป็น batch เดียว
+        bool flush_scheduled = false;
+    };
+
+    struct Inbound {
+        string node; // ว่างจนกว่าจะได้ HELLO
+        string rbuf;
+    };
+
+    static constexpr size_t MAX_PENDING = 4 << 20;  // บัฟเฟอร์สูงสุดต่อ peer ระหว่างที่ยังเชื่อมต่อไม่ได้
+    static constexpr uint32_t MAX_FRAME = 64 << 10;
+
+    string self;
+    vector<string> nodes;
+    map<string, unique_ptr<Peer>> peers; // ไม่เปลี่ยนหลัง constructor จึงอ่านจากหลาย thread ได้
+    unordered_map<int, Inbound> inbound;
+    int listen_fd = -1;
+    SayHandler on_say;
+
+    mutex interest_mtx;
+    map<string, set<string>> interest; // (home) ห้อง -> peer ที่มีสมาชิก
+    set<string> announced;             // (edge) ห้องที่แจ้ง SUB ไปยัง home แล้ว
+
+    EventLoop loop;
+    thread loop_thread;
+
+    static bool splitAddress(const string &addr, string &host, string &port) {
+        size_t colon = addr.rfind(':');
+        if (colon == string::npos || colon == 0 || colon + 1 == addr.size()) return false;
+        host = addr.substr(0, colon);
+        port = addr.substr(colon + 1);
+        return true;
+    }
+
+    // FNV-1a: ต้องให้ผลเหมือนกันทุก router จึงไม่ใช้ std::hash
+    static uint64_t fnv1a(const string &a, const string &b) {
+        uint64_t h = 1469598103934665603ull;
+        for (unsigned char c : a) h = (h ^ c) * 1099511628211ull;
+        h = (h ^ 0xff) * 1099511628211ull;
+        for (unsigned char c : b) h = (h ^ c) * 1099511628211ull;
+        return h;
+    }
+
+    static int openSocket(const string &host, const string &port, bool listening) {
+        addrinfo hints{}, *res = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (listening) hints.ai_flags = AI_PASSIVE;
+        int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+        if (rc != 0) {
+            cerr << "[Federation] Cannot resolve " << host << ":" << port << ": " << gai_strerror(rc) << endl;
+            return -1;
+        }
+
+        int fd = -1;
+        for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd == -1) continue;
+            int one = 1;
+            if (listening) {
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0) break;
+            } else {
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // batch เองแล้ว ไม่ต้องรอ Nagle
+                if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS) break;
+            }
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(res);
+        return fd;
+    }
+
+    void send(const string &node, const string &frame) {
+        auto it = peers.find(node);
+        if (it == peers.end()) return;
+        Peer &peer = *it->second;
+
+        lock_guard<mutex> lock(peer.out_mtx);
+        if (peer.pending.size() + frame.size() > MAX_PENDING) {
+            cerr << "[Federation] Outbound buffer to " << node << " full, frame dropped.\n";
+            return;
+        }
+        peer.pending += frame;
+        if (!peer.flush_scheduled) {
+            peer.flush_scheduled = true;
+            loop.post([this, &peer]() { flush(peer); });
+        }
+    }
+
+    void flush(Peer &peer) {
+        {
+            lock_guard<mutex> lock(peer.out_mtx);
+            peer.flush_scheduled = false;
+            if (!peer.connected) return; // เก็บไว้ใน pending จนกว่าจะเชื่อมต่อได้
+            peer.wbuf += peer.pending;
+            peer.pending.clear();
+        }
+
+        size_t off = 0;
+        while (off < peer.wbuf.size()) {
+            ssize_t n = ::send(peer.fd, peer.wbuf.data() + off, peer.wbuf.size() - off, MSG_NOSIGNAL);
+            if (n > 0) {
+                off += (size_t)n;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && errno == EAGAIN) {
+                break;
+            } else {
+                perror("[Federation] send failed");
+                dropPeer(peer);
+                return;
+            }
+        }
+        peer.wbuf.erase(0, off);
+
+        bool want = !peer.wbuf.empty();
+        if (want != peer.want_write) {
+            peer.want_write = want;
+            loop.modify(peer.fd, want ? EPOLLIN | EPOLLOUT : EPOLLIN);
+        }
+    }
+
+    void connectPeer(Peer &peer) {
+        peer.fd = openSocket(peer.host, peer.port, false);
+        if (peer.fd == -1) return;
+        peer.want_write = true;
+        loop.add(peer.fd, EPOLLIN | EPOLLOUT, [this, &peer](uint32_t events) { onPeerEvent(peer, events); });
+    }
+
+    void onPeerEvent(Peer &peer, uint32_t events) {
+        if (!peer.connected) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(peer.fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+                dropPeer(peer);
+                return;
+            }
+            onPeerConnected(peer);
+            return;
+        }
+
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            // ขาออกไม่มีข้อมูลตอบกลับ อ่านได้แปลว่า peer ปิดการเชื่อมต่อ
+            char tmp[256];
+            ssize_t n = recv(peer.fd, tmp, sizeof(tmp), 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                dropPeer(peer);
+                return;
+            }
+        }
+        if (events & EPOLLOUT) flush(peer);
+    }
+
+    void onPeerConnected(Peer &peer) {
+        cout << "[Federation] Connected to peer " << peer.node << endl;
+
+        FrameWriter hello;
+        hello.str(self);
+        peer.wbuf = FrameWriter::frame(FRAME_HELLO, hello.buf);
+
+        // ส่ง SUB ซ้ำทุกครั้งที่เชื่อมต่อใหม่ เพราะ home ล้าง interest ของเราทิ้งตอนหลุด
+        {
+            lock_guard<mutex> lock(interest_mtx);
+            for (const auto &room : announced) {
+                if (homeOf(room) != peer.node) continue;
+                FrameWriter w;
+                w.str(room);
+                peer.wbuf += FrameWriter::frame(FRAME_SUB, w.buf);
+            }
+        }
+        {
+            lock_guard<mutex> lock(peer.out_mtx);
+            peer.connected = true;
+        }
+        flush(peer);
+    }
+
+    void dropPeer(Peer &peer) {
+        if (peer.connected) cerr << "[Federation] Lost connection to peer " << peer.node << endl;
+        loop.remove(peer.fd);
+        close(peer.fd);
+        peer.fd = -1;
+        peer.want_write = false;
+        peer.wbuf.clear();
+        lock_guard<mutex> lock(peer.out_mtx);
+        peer.connected = false;
+    }
+
+    void onAccept() {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd == -1) {
+                if (errno != EAGAIN && errno != EINTR) perror("[Federation] accept failed");
+                return;
+            }
+            inbound[fd] = Inbound{};
+            loop.add(fd, EPOLLIN, [this, fd](uint32_t) { onInboundReadable(fd); });
+        }
+    }
+
+    void closeInbound(int fd) {
+        auto it = inbound.find(fd);
+        if (it != inbound.end() && !it->second.node.empty()) {
+            lock_guard<mutex> lock(interest_mtx);
+            for (auto &entry : interest) entry.second.erase(it->second.node);
+        }
+        inbound.erase(fd);
+        loop.remove(fd);
+        close(fd);
+    }
+
+    void onInboundReadable(int fd) {
+        Inbound &in = inbound[fd];
+        char buf[16384];
+        bool closed = false; // EOF/error: ยังต้อง parse เฟรมที่มากับ wakeup เดียวกันก่อนปิด
+        while (true) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                in.rbuf.append(buf, (size_t)n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno == EAGAIN) break;
+            closed = true;
+            break;
+        }
+
+        // หนึ่งครั้งที่อ่านอาจได้หลายเฟรม (sender รวมเป็น batch)
+        size_t off = 0;
+        while (in.rbuf.size() - off >= 4) {
+            FrameReader header(in.rbuf.data() + off, 4);
+            uint32_t len = header.u32();
+            if (len == 0 || len > MAX_FRAME) {
+                cerr << "[Federation] Invalid frame length " << len << ", closing connection.\n";
+                closeInbound(fd);
+                return;
+            }
+            if (in.rbuf.size() - off - 4 < len) break;
+            FrameReader body(in.rbuf.data() + off + 4, len);
+            uint8_t type = body.u8();
+            handleFrame(in, (FrameType)type, body);
+            off += 4 + len;
+        }
+        in.rbuf.erase(0, off);
+        if (closed) closeInbound(fd);
+    }
+
+    void handleFrame(Inbound &in, FrameType type, FrameReader &r) {
+        if (type == FRAME_HELLO) {
+            in.node = r.str();
+            cout << "[Federation] Peer " << in.node << " attached" << endl;
+            return;
+        }
+        if (in.node.empty()) {
+            cerr << "[Federation] Frame before HELLO ignored.\n";
+            return;
+        }
+
+        if (type == FRAME_SUB || type == FRAME_UNSUB) {
+            string room = r.str();
+            if (!r.ok) return;
+            lock_guard<mutex> lock(interest_mtx);
+            if (type == FRAME_SUB)
+                interest[room].insert(in.node);
+            else if (interest.count(room) && interest[room].erase(in.node) && interest[room].empty())
+                interest.erase(room);
+        } else if (type == FRAME_SAY) {
+            FederatedSay say;
+            say.room = r.str();
+            say.origin = r.str();
+            say.sender = (int)r.u32();
+            say.timestamp = (long long)r.u64();
+            say.text = r.str();
+            if (!r.ok) {
+                cerr << "[Federation] Malformed SAY frame from " << in.node << endl;
+                return;
+            }
+            if (on_say) on_say(say);
+            publish(say);
+        } else {
+            cerr << "[Federation] Unknown frame type " << (int)type << " from " << in.node << endl;
+        }
+    }
+
+public:
+    Federation(const string &node, const vector<string> &peer_addrs, SayHandler handler)
+        : self(node), on_say(std::move(handler)) {
+        string host, port;
+        if (!splitAddress(self, host, port))
+            throw runtime_error("Invalid federation node address: " + self);
+        listen_fd = openSocket(host, port, true);
+        if (listen_fd == -1)
+            throw runtime_error("Cannot listen on " + self + ": " + strerror(errno));
+
+        nodes.push_back(self);
+        for (const auto &addr : peer_addrs) {
+            if (addr == self || peers.count(addr)) continue;
+            auto peer = make_unique<Peer>();
+            if (!splitAddress(addr, peer->host, peer->port)) {
+                cerr << "[Federation] Invalid peer address ignored: " << addr << endl;
+                continue;
+            }
+            peer->node = addr;
+            nodes.push_back(addr);
+            peers[addr] = std::move(peer);
+        }
+        sort(nodes.begin(), nodes.end());
+
+        loop.add(listen_fd, EPOLLIN, [this](uint32_t) { onAccept(); });
+        for (auto &p : peers) connectPeer(*p.second);
+        loop.addTimer(seconds(1), [this]() {
+            for (auto &p : peers)
+                if (p.second->fd == -1) connectPeer(*p.second);
+        });
+
+        loop_thread = thread([this] { loop.run(); });
+        cout << "[Federation] Node " << self << " listening with " << peers.size() << " peer(s)" << endl;
+    }
+
+    const string &nodeId() const { return self; }
+
+    // rendezvous hashing: node ที่ได้ค่า hash สูงสุดกับชื่อห้องเป็น home
+    const string &homeOf(const string &room) const {
+        const string *best = &nodes[0];
+        uint64_t best_score = 0;
+        for (const auto &n : nodes) {
+            uint64_t score = fnv1a(n, room);
+            if (score > best_score || (score == best_score && n < *best)) {
+                best_score = score;
+                best = &n;
+            }
+        }
+        return *best;
+    }
+
+    // เรียกหลัง join/leave: แจ้ง home เมื่อห้องนี้เริ่มมีหรือไม่มีสมาชิกใน router นี้แล้ว
+    void updateInterest(Room *room) {
+        const string &home = homeOf(room->room_name);
+        if (home == self) return;
+
+        lock_guard<mutex> lock(interest_mtx);
+        bool has_members = room->size() > 0;
+        FrameType type;
+        if (has_members && announced.insert(room->room_name).second)
+            type = FRAME_SUB;
+        else if (!has_members && announced.erase(room->room_name))
+            type = FRAME_UNSUB;
+        else
+            return;
+
+        FrameWriter w;
+        w.str(room->room_name);
+        send(home, FrameWriter::frame(type, w.buf));
+    }
+
+    // ส่งต่อ say: ถ้าเราเป็น home ส่ง peer ที่สนใจ peer ละครั้ง (ยกเว้นต้นทาง), ถ้าข้อความมาจาก client ในเครื่องส่งไป home
+    void publish(const FederatedSay &say) {
+        const string &home = homeOf(say.room);
+        vector<string> targets;
+        if (home == self) {
+            lock_guard<mutex> lock(interest_mtx);
+            auto it = interest.find(say.room);
+            if (it != interest.end())
+                for (const auto &n : it->second)
+                    if (n != say.origin) targets.push_back(n);
+        } else if (say.origin == self) {
+            targets.push_back(home);
+        }
+        if (targets.empty()) return;
+
+        FrameWriter w;
+        w.str(say.room);
+        w.str(say.origin);
+        w.u32((uint32_t)say.sender);
+        w.u64((uint64_t)say.timestamp);
+        w.str(say.text);
+        string frame = FrameWriter::frame(FRAME_SAY, w.buf);
+        for (const auto &n : targets) send(n, frame);
+    }
+
+    ~Federation() {
+        loop.stop();
+        if (loop_thread.joinable()) loop_thread.join();
+        for (auto &p : peers)
+            if (p.second->fd != -1) close(p.second->fd);
+        for (auto &in : inbound) close(in.first);
+        if (listen_fd != -1) close(listen_fd);
+    }
+};
+
+// สัญญาณที่ใช้สั่งปิด server ใน reactor backend
+sigset_t shutdownSignals() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    return mask;
+}
+
 // คลาส Router
 class Router {
 private:
     map<int, Client *> clients;
     map<string, Room *> rooms;
-    ThreadPool pool;
+    mutex registry_mtx; // ป้องกัน clients/rooms ที่ถูกเข้าถึงจากทั้ง worker และ federation thread
+    ThreadPool inbound_pool;  // handleMessage
+    ThreadPool outbound_pool; // fan-out msgsnd ไปยังผู้รับ
+    unique_ptr<Federation> federation;
+    SearchIndex search_index;
+    SubscriptionTrie subscriptions;
+    FilterPipeline filters;
+
+    // loop สำหรับงานเบื้องหลังตามเวลา (เช่น reload รายการคำต้องห้าม, autoscale) เริ่มเมื่อมีงานแรก
+    unique_ptr<EventLoop> service_loop;
+    thread service_thread;
+
+    EventLoop &serviceLoop() {
+        if (!service_loop) {
+            service_loop = make_unique<EventLoop>();
+            service_thread = thread([this] { service_loop->run(); });
+        }
+        return *service_loop;
+    }
+
+    // ขอบเขตและสถานะของ autoscaler ต่อ pool
+    struct ScalePolicy {
+        size_t min;
+        size_t max;
+        int idle_ticks = 0;
+    };
+    ScalePolicy inbound_policy;
+    ScalePolicy outbound_policy;
+    // descriptor ของ mq ขาเข้า (reactor backend) ที่ Router เปิดไว้ให้ autoscaler อ่านความลึกโดยเฉพาะ
+    // แยกจาก descriptor ของ shard เพราะ shard ปิดของตัวเองตอนจบ startReactor ขณะที่ service loop อาจยังอ่านอยู่
+    // ปิดใน ~Router หลังหยุด service loop แล้ว
+    atomic<mqd_t> reactor_mq{(mqd_t)-1};
+
+    static constexpr long long SCALE_UP_WAIT_US = 2000; // งานรอในคิวเฉลี่ยนานกว่านี้ให้เพิ่ม worker
+    static constexpr long SCALE_UP_QUEUE_FULL_PCT = 75; // mq ขาเข้าใช้ไปถึงกี่ % ของความจุจึงนับเป็นแรงกดดัน
+    static constexpr int SCALE_DOWN_IDLE_TICKS = 10;    // ว่างต่อเนื่องกี่รอบก่อนลด worker ทีละ 1
+
+    // queue_depth/queue_capacity = ความลึกของ mq ขาเข้า (capacity 0 = ไม่มีสัญญาณนี้)
+    // can_grow = false เมื่อรู้ว่าเพิ่ม worker ไปก็ไม่ช่วย (เช่น worker block อยู่ใน msgsnd)
+    void scalePool(ThreadPool &pool, ScalePolicy &policy, long queue_depth, long queue_capacity, bool can_grow,
+                   const msqid_ds &ds) {
+        ThreadPool::Stats st = pool.stats();
+        size_t target = st.workers;
+
+        // เกณฑ์เทียบกับความจุจริงของ queue (mq ค่าเริ่มต้นมีแค่ 10 ช่อง) และนับเฉพาะตอนที่ worker ทุกตัวไม่ว่าง
+        // queue ที่ลึกขณะ pool ว่างแปลว่าคอขวดอยู่ที่อื่น เพิ่ม worker ไปก็ไม่ช่วย
+        long queue_threshold = max(1L, queue_capacity * SCALE_UP_QUEUE_FULL_PCT / 100);
+        bool saturated = st.backlog > 0 || (size_t)st.busy >= st.workers;
+        bool queue_pressured = queue_capacity > 0 && queue_depth >= queue_threshold && saturated;
+        bool pressured = st.backlog > st.workers || st.wait_us > SCALE_UP_WAIT_US || queue_pressured;
+        bool idle = st.backlog == 0 && (size_t)st.busy * 2 < st.workers;
+        if (pressured) {
+            policy.idle_ticks = 0;
+            if (can_grow) target = min(policy.max, st.workers + max<size_t>(1, st.workers / 2));
+        } else if (idle && ++policy.idle_ticks >= SCALE_DOWN_IDLE_TICKS) {
+            policy.idle_ticks = 0;
+            target = max(policy.min, st.workers - 1);
+        } else if (!idle) {
+            policy.idle_ticks = 0;
+        }
+        target = max(policy.min, min(policy.max, target));
+        if (target == st.workers) return;
+
+        cout << "[Autoscale][" << pool.poolName() << "] " << st.workers << " -> " << target << " workers (backlog "
+             << st.backlog << ", busy " << st.busy << ", wait " << st.wait_us / 1000.0 << " ms, ";
+        if (queue_capacity > 0) cout << "mq " << queue_depth << "/" << queue_capacity << ", ";
+        cout << "queue " << ds.msg_qnum << " msgs/" << ds.msg_cbytes << " bytes)" << endl;
+        pool.resize(target);
+    }
+
+    void autoscaleTick() {
+        msqid_ds ds{};
+        msgctl(msgid, IPC_STAT, &ds); // ใช้แสดงใน log เท่านั้น
+        // System V queue ปนทั้งข้อความขาเข้าและข้อความที่รอ client อ่าน (รวมของ client ที่ตายไปแล้ว)
+        // ความลึกของมันจึงไม่ใช่แรงกดดันของ pool; backend แบบเดิมใช้แค่ backlog/เวลารอของ pool เอง
+        // reactor backend รับขาเข้าจาก POSIX mq แยกต่างหาก ความลึกของ mq นั้นจึงใช้กับ pool ขาเข้าได้
+        long depth = 0, capacity = 0;
+        mq_attr attr{};
+        mqd_t mq = reactor_mq.load();
+        if (mq != (mqd_t)-1 && mq_getattr(mq, &attr) == 0 && attr.mq_maxmsg > 0) {
+            depth = attr.mq_curmsgs;
+            capacity = attr.mq_maxmsg;
+        }
+        // worker ขาออก block ใน msgsnd เมื่อ System V queue เต็ม (เช่นมีข้อความค้างของ client ที่ตายแล้ว)
+        // backlog/เวลารอที่สูงขึ้นตอนนั้นไม่ได้แปลว่าเพิ่ม worker แล้วจะเร็วขึ้น จึงคงจำนวนไว้
+        bool sysv_full = ds.msg_qbytes > 0 && ds.msg_qbytes - ds.msg_cbytes < sizeof(msg_buffer);
+        scalePool(inbound_pool, inbound_policy, depth, capacity, true, ds);
+        scalePool(outbound_pool, outbound_policy, 0, 0, !sysv_full, ds);
+    }
+
+    // ตรวจข้อความก่อน fan-out; ถ้าไม่ผ่านแจ้ง error กลับไปยังผู้ส่ง
+    bool passesFilters(int clientID, const string &text, long long timestamp) {
+        if (filters.empty()) return true;
+        string reason;
+        if (filters.allow(text, reason)) return true;
+        cout << "[Filter][Blocked][From:" << clientID << "] " << reason << endl;
+        sendErrorToClient(clientID, "Message blocked by moderation filter", timestamp);
+        return false;
+    }
+
+    // สถานะของ event loop หนึ่งตัวใน reactor backend
+    struct ReactorShard {
+        EventLoop loop;
+        mqd_t mq = (mqd_t)-1;
+        atomic<int> inflight{0};  // ข้อความที่ส่งเข้า pool แล้วแต่ยังไม่เสร็จ
+        atomic<bool> paused{false};
+        atomic<unsigned long long> *received = nullptr;
+    };
+
+    static constexpr int REACTOR_BATCH = 64;          // อ่านจาก mq ได้สูงสุดต่อ 1 event
+    static constexpr int REACTOR_HIGH_WATER = 1024;   // งานค้างใน pool เกินนี้ให้หยุดอ่าน mq ชั่วคราว
+    static constexpr int REACTOR_LOW_WATER = 256;
+
+    // ลงทะเบียน mq ของ shard เข้า epoll; EPOLLEXCLUSIVE ลดการปลุกทุก loop พร้อมกัน
+    void armShard(ReactorShard &shard) {
+        shard.loop.add((int)shard.mq, EPOLLIN | EPOLLEXCLUSIVE, [this, &shard](uint32_t) { drainShard(shard); });
+    }
+
+    void drainShard(ReactorShard &shard) {
+        for (int i = 0; i < REACTOR_BATCH; ++i) {
+            msg_buffer message{};
+            ssize_t len = mq_receive(shard.mq, (char *)&message, sizeof(message), nullptr);
+            if (len < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) return;
+                // mq ลงทะเบียนแบบ level-triggered ถ้าคืนไปเฉยๆ epoll จะปลุกซ้ำทันทีไม่รู้จบ จึงเลิก poll shard นี้
+                perror("[Reactor] mq_receive failed, shard stops reading");
+                shard.loop.remove((int)shard.mq);
+                return;
+            }
+            if (shard.received) ++*shard.received;
+
+            // completion จาก worker กลับเข้า loop ผ่าน eventfd เฉพาะตอนที่ loop หยุดอ่านอยู่
+            // ต้องตั้ง paused ก่อนส่งข้อความที่ทำให้ถึง high water เข้า pool ไม่อย่างนั้นงานทั้งหมดอาจเสร็จก่อน
+            // ที่ paused จะถูกตั้ง แล้วไม่มี completion ไหนเห็น paused เพื่อ arm shard กลับมาอีก
+            bool pause = ++shard.inflight >= REACTOR_HIGH_WATER;
+            if (pause) {
+                shard.paused = true;
+                shard.loop.remove((int)shard.mq);
+            }
+            // ลด inflight เป็นการแตะ shard ครั้งสุดท้าย เพราะ startReactor ทำลาย shard ทันทีที่ inflight เป็น 0
+            dispatch(message, [this, &shard]() {
+                if (shard.paused.load() && shard.inflight.load() - 1 <= REACTOR_LOW_WATER)
+                    shard.loop.post([this, &shard]() {
+                        if (shard.paused.exchange(false)) armShard(shard);
+                    });
+                --shard.inflight;
+            });
+            if (pause) return;
+        }
+    }
 
     // ส่งข้อความ error กลับไปยัง client
     void sendErrorToClient(int clientID, const string &err, long long timestamp = 0) const {
@@ -245,13 +1761,21 @@ private:
     }
 
 public:
-    explicit Router(int _msgid) : pool(CONFIG_BC_THREAD) { msgid = _msgid; }
+    Router(int _msgid, const ServerOptions &opt)
+        : inbound_pool(opt.inbound_threads, "inbound", opt.inbound_cpus),
+          outbound_pool(opt.outbound_threads, "outbound", opt.outbound_cpus),
+          search_index(opt.search_retention),
+          inbound_policy{opt.inbound_min, opt.inbound_max},
+          outbound_policy{opt.outbound_min, opt.outbound_max} {
+        msgid = _msgid;
+    }
 
     Client *CreateOrFindClient(int client_id) {
         if (client_id <= 0) {
             cerr << "[Router] Invalid client id: " << client_id << endl;
             return nullptr;
         }
+        lock_guard<mutex> lock(registry_mtx);
         if (clients.find(client_id) != clients.end())
             return clients[client_id];
 
@@ -271,6 +1795,7 @@ public:
             return nullptr;
         }
 
+        lock_guard<mutex> lock(registry_mtx);
         auto it = rooms.find(name);
         if (it != rooms.end()) return it->second;
 
@@ -278,6 +1803,8 @@ public:
 
         try {
             Room *newroom = new Room(name);
+            newroom->index = &search_index;
+            newroom->subscriptions = &subscriptions;
             rooms[name] = newroom;
             return newroom;
         } catch (const bad_alloc &) {
@@ -286,6 +1813,50 @@ public:
         }
     }
 
+    // เปิด moderation filter จากไฟล์ ตรวจไฟล์ทุก 2 วินาทีและ reload โดยไม่หยุดรับข้อความ
+    void enableModeration(const string &path) {
+        auto filter = make_shared<ModerationFilter>(path);
+        filters.add(filter);
+
+        EventLoop &loop = serviceLoop();
+        loop.post([&loop, filter]() {
+            loop.addTimer(seconds(2), [filter]() { filter->reloadIfChanged(); });
+        });
+    }
+
+    // ปรับขนาด inbound/outbound pool อัตโนมัติภายในขอบเขต min/max ทุก interval
+    void enableAutoscale(milliseconds interval) {
+        EventLoop &loop = serviceLoop();
+        loop.post([this, &loop, interval]() {
+            loop.addTimer(interval, [this]() { autoscaleTick(); });
+        });
+        cout << "[Autoscale] Enabled: inbound " << inbound_policy.min << "-" << inbound_policy.max << ", outbound "
+             << outbound_policy.min << "-" << outbound_policy.max << " workers, every " << interval.count() << " ms" << endl;
+    }
+
+    // เปิด federation: say ในห้องจะถูกส่งต่อไปยัง router อื่นที่มีสมาชิกของห้องเดียวกัน
+    void enableFederation(const string &node, const vector<string> &peers) {
+        federation = make_unique<Federation>(node, peers, [this](const FederatedSay &say) {
+            // ปลายทาง: กระจายให้สมาชิกใน router นี้เท่านั้น
+            if (Room *room = CreateOrFindRoom(say.room, false))
+                room->BoardCast(say.text, outbound_pool, say.timestamp, say.sender);
+        });
+    }
+
+    // ส่งข้อความเข้า pool, done (ถ้ามี) จะถูกเรียกหลัง handleMessage จบใน worker thread
+    void dispatch(const msg_buffer &message, function<void()> done = nullptr) {
+        inbound_pool.enqueue([this, message, done]() {
+            try {
+                handleMessage(message);
+            } catch (const exception &e) {
+                cerr << "[Router] handleMessage exception: " << e.what() << endl;
+            } catch (...) {
+                cerr << "[Router] Unknown error in handleMessage.\n";
+            }
+            if (done) done();
+        });
+    }
+
     void start() {
         cout << "[Router] Started. Waiting for messages..." << endl;
         while (true) {
@@ -293,21 +1864,90 @@ public:
             // รับข้อความจาก message type 1 (เป็น convention สำหรับ router/server)
             ssize_t result = msgrcv(msgid, &message, sizeof(message) - sizeof(long), 1, 0); 
             if (result < 0) {
+                if (errno == EINTR) continue;
                 perror("[Router] msgrcv failed");
                 this_thread::sleep_for(chrono::milliseconds(200));
                 continue;
             }
 
-            pool.enqueue([=]() {
-                try {
-                    handleMessage(message);
-                } catch (const exception &e) {
-                    cerr << "[Router] handleMessage exception: " << e.what() << endl;
-                } catch (...) {
-                    cerr << "[Router] Unknown error in handleMessage.\n";
-                }
+            dispatch(message);
+        }
+    }
+
+    // Reactor backend: รับข้อความจาก POSIX mq (poll ได้) ด้วย epoll หนึ่ง loop ต่อ core
+    // timer (heartbeat), signal และ completion จาก worker ถูกรวมไว้ใน loop เดียวกันโดยไม่ต้องมี thread ที่ block
+    void startReactor(const string &mq_name, int loops) {
+        if (loops <= 0) loops = max(1u, thread::hardware_concurrency());
+
+        mq_attr attr{};
+        attr.mq_maxmsg = 10; // ค่าสูงสุดที่ user ทั่วไปสร้างได้ (/proc/sys/fs/mqueue/msg_max)
+        attr.mq_msgsize = sizeof(msg_buffer);
+        mqd_t probe = mq_open(mq_name.c_str(), O_CREAT | O_RDONLY | O_NONBLOCK, 0666, &attr);
+        if (probe == (mqd_t)-1)
+            throw runtime_error("mq_open " + mq_name + " failed: " + strerror(errno));
+        mq_getattr(probe, &attr);
+        mq_close(probe);
+        // mq ที่มีอยู่แล้วอาจถูกสร้างด้วยขนาดอื่น (เช่นค่า default 8192) ซึ่ง mq_receive เข้า msg_buffer จะได้ EMSGSIZE ตลอด
+        if (attr.mq_msgsize != (long)sizeof(msg_buffer))
+            throw runtime_error("mq " + mq_name + " has message size " + to_string(attr.mq_msgsize) + ", expected " +
+                                to_string(sizeof(msg_buffer)) + " (mq_unlink it or use another mq-name)");
+
+        // SIGINT/SIGTERM ถูกส่งเข้า signalfd ของ loop แรกแทน handler แบบ async
+        // (main() block สัญญาณไว้ก่อนสร้าง Router เพื่อให้ worker ใน pool สืบทอด mask ไปด้วย)
+        sigset_t mask = shutdownSignals();
+        pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+        vector<unique_ptr<ReactorShard>> shards;
+        for (int i = 0; i < loops; ++i) {
+            auto shard = make_unique<ReactorShard>();
+            shard->mq = mq_open(mq_name.c_str(), O_RDONLY | O_NONBLOCK);
+            if (shard->mq == (mqd_t)-1)
+                throw runtime_error("mq_open " + mq_name + " failed: " + strerror(errno));
+            armShard(*shard);
+            shards.push_back(std::move(shard));
+        }
+
+        atomic<unsigned long long> received{0};
+        for (auto &shard : shards) shard->received = &received;
+
+        mqd_t stats_mq = mq_open(mq_name.c_str(), O_RDONLY | O_NONBLOCK);
+        if (stats_mq == (mqd_t)-1)
+            perror("[Reactor] mq_open for autoscaler failed");
+        else
+            reactor_mq = stats_mq;
+
+        EventLoop &main_loop = shards[0]->loop;
+        int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (sfd == -1) {
+            perror("[Reactor] signalfd failed");
+        } else {
+            main_loop.add(sfd, EPOLLIN, [&shards, sfd](uint32_t) {
+                signalfd_siginfo info;
+                if (read(sfd, &info, sizeof(info)) <= 0) return;
+                cout << "[Reactor] Signal " << info.ssi_signo << " received, stopping..." << endl;
+                for (auto &s : shards) s->loop.stop();
             });
         }
+        main_loop.addTimer(seconds(30), [&received, &shards]() {
+            int inflight = 0;
+            for (auto &s : shards) inflight += s->inflight.load();
+            cout << "[Reactor] Heartbeat: received " << received.load() << " messages, in-flight " << inflight << endl;
+        });
+
+        cout << "[Router] Reactor started on " << mq_name << " with " << loops << " loop(s). Waiting for messages..." << endl;
+        vector<thread> threads;
+        for (size_t i = 1; i < shards.size(); ++i)
+            threads.emplace_back([&shards, i] { shards[i]->loop.run(); });
+        main_loop.run();
+        for (auto &t : threads) t.join();
+
+        // รอให้งานที่ค้างอยู่ใน pool ส่ง completion กลับมาก่อนทำลาย shard
+        for (auto &s : shards)
+            while (s->inflight.load() > 0) this_thread::sleep_for(milliseconds(1));
+
+        for (auto &s : shards) mq_close(s->mq);
+        if (sfd != -1) close(sfd);
+        mq_unlink(mq_name.c_str());
     }
 
     void handleMessage(const msg_buffer &message) {
@@ -346,8 +1986,13 @@ public:
                 sendErrorToClient(clientID, "Unexpected extra text after join command", message.send_timestamp);
                 return;
             }
+            if (!SubscriptionTrie::isValidName(roomStr, false)) {
+                sendErrorToClient(clientID, "Invalid room name (use a.b.c without * or #): " + roomStr, message.send_timestamp);
+                return;
+            }
             if (Room *room = CreateOrFindRoom(roomStr)) {
                 room->join(client);
+                if (federation) federation->updateInterest(room);
                 sendInfoToClient(clientID, "Joined room " + roomStr + " successfully", message.send_timestamp);
             } else {
                 sendErrorToClient(clientID, "Cannot join room: " + roomStr, message.send_timestamp);
@@ -364,17 +2009,23 @@ public:
                 sendErrorToClient(clientID, "Missing message text in say command", message.send_timestamp);
                 return;
             }
+            if (!passesFilters(clientID, textStr, message.send_timestamp)) return;
             Room *room = CreateOrFindRoom(roomStr, false); // ไม่สร้างถ้าไม่มี
-            if (!room) {
+            // ใน federation ห้องอาจมีสมาชิกอยู่ที่ router อื่นเท่านั้น จึงไม่ถือว่าไม่พบห้อง
+            if (!room && !federation) {
                 sendErrorToClient(clientID, "Room not found: " + roomStr, message.send_timestamp);
                 return;
             }
             // ส่ง clientID (Sender)
-            room->BoardCast(textStr, pool, message.send_timestamp, clientID);
+            if (room)
+                room->BoardCast(textStr, outbound_pool, message.send_timestamp, clientID);
+            if (federation)
+                federation->publish(FederatedSay{roomStr, federation->nodeId(), clientID, message.send_timestamp, textStr});
         }
 
         // DM
         else if (cmdStr == "dm" && n >= 3) {
+            if (!passesFilters(clientID, textStr, message.send_timestamp)) return;
             try {
                 int targetID = stoi(roomStr); // targetID อยู่ในตำแหน่ง roomStr
                 
@@ -407,42 +2058,131 @@ public:
                 return;
             }
             bool ok = room->leave(client);
+            if (ok && federation) federation->updateInterest(room);
             if (!ok)
                 sendErrorToClient(clientID, "You are not in room: " + roomStr, message.send_timestamp);
             else
                 sendInfoToClient(clientID, "Left room " + roomStr + " successfully", message.send_timestamp);
         }
 
+        // SUBSCRIBE / UNSUBSCRIBE: ติดตามทุกห้องที่ตรงกับ pattern ด้วยคำสั่งเดียว
+        else if (cmdStr == "subscribe" || cmdStr == "unsubscribe") {
+            if (n != 2) {
+                sendErrorToClient(clientID, "Usage: " + cmdStr + " <pattern> (e.g. team.* or team.#)", message.send_timestamp);
+                return;
+            }
+            if (!SubscriptionTrie::isValidName(roomStr, true)) {
+                sendErrorToClient(clientID, "Invalid pattern: " + roomStr, message.send_timestamp);
+                return;
+            }
+            if (cmdStr == "subscribe") {
+                if (subscriptions.subscribe(roomStr, client)) {
+                    cout << "[Subscribe][" << client->name << "][" << roomStr << "]\n";
+                    sendInfoToClient(clientID, "Subscribed to " + roomStr, message.send_timestamp);
+                } else {
+                    sendErrorToClient(clientID, "Already subscribed to " + roomStr, message.send_timestamp);
+                }
+            } else {
+                if (subscriptions.unsubscribe(roomStr, client)) {
+                    cout << "[Unsubscribe][" << client->name << "][" << roomStr << "]\n";
+                    sendInfoToClient(clientID, "Unsubscribed from " + roomStr, message.send_timestamp);
+                } else {
+                    sendErrorToClient(clientID, "Not subscribed to " + roomStr, message.send_timestamp);
+                }
+            }
+        }
+
+        // SEARCH: search <room_name> <terms...> [page=N]
+        else if (cmdStr == "search") {
+            if (n < 3 || textStr.empty()) {
+                sendErrorToClient(clientID, "Usage: search <room_name> <terms> [page=N]", message.send_timestamp);
+                return;
+            }
+
+            size_t page = 1;
+            string query = textStr;
+            size_t last = query.find_last_of(' ');
+            string tail = last == string::npos ? query : query.substr(last + 1);
+            if (tail.rfind("page=", 0) == 0) {
+                try {
+                    int p = stoi(tail.substr(5));
+                    if (p <= 0) throw invalid_argument("page");
+                    page = (size_t)p;
+                } catch (...) {
+                    sendErrorToClient(clientID, "Invalid page: " + tail, message.send_timestamp);
+                    return;
+                }
+                query = last == string::npos ? "" : query.substr(0, last);
+            }
+
+            auto started = steady_clock::now();
+            SearchIndex::Result result;
+            if (!search_index.search(roomStr, query, page, result)) {
+                sendErrorToClient(clientID, "Search terms too short: " + query, message.send_timestamp);
+                return;
+            }
+            double took_ms = duration_cast<microseconds>(steady_clock::now() - started).count() / 1000.0;
+            string total = (result.approximate ? "~" : "") + to_string(result.total);
+            cout << "[Search][" << clientID << "][" << roomStr << "] '" << query << "' -> " << total
+                 << " hit(s) in " << took_ms << " ms" << endl;
+
+            size_t pages = max<size_t>(1, (result.total + SearchIndex::PAGE_SIZE - 1) / SearchIndex::PAGE_SIZE);
+            if (page > pages) {
+                sendErrorToClient(clientID, "Page " + to_string(page) + " out of range (1-" + to_string(pages) + ")",
+                                  message.send_timestamp);
+                return;
+            }
+            sendInfoToClient(clientID, "Search '" + query + "' in " + roomStr + ": " + total + " hit(s), page " +
+                                           to_string(page) + "/" + to_string(pages),
+                             message.send_timestamp);
+            for (const auto &hit : result.hits) {
+                time_t sec = (time_t)(hit.timestamp / 1000000);
+                tm local{};
+                localtime_r(&sec, &local);
+                char when[32];
+                strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &local);
+                sendInfoToClient(clientID, string("[") + when + "][From:" + to_string(hit.sender) + "]: " + hit.text,
+                                 message.send_timestamp);
+            }
+        }
+
         // online (ใช้ตรวจสอบสถานะ client)
         else if (cmdStr == "online") {
             // ส่ง clientID (Sender)
             string list;
-            for (const auto &p : clients) {
-                if (!list.empty()) list += ", ";
-                list += to_string(p.first);
+            vector<int> others;
+            {
+                lock_guard<mutex> lock(registry_mtx);
+                for (const auto &p : clients) {
+                    if (!list.empty()) list += ", ";
+                    list += to_string(p.first);
+                    if (p.first != clientID) others.push_back(p.first);
+                }
             }
             string info = "Online clients: [" + list + "]";
             sendInfoToClient(clientID, info, message.send_timestamp);
             cout << "[Info][" << client->name << "][Online] " << info << endl;
 
             // แจ้ง client อื่น ๆ ว่า client นี้ออนไลน์
-            for (const auto &p : clients) {
-                int otherID = p.first;
-                if (otherID == clientID) continue;
+            for (int otherID : others)
                 sendInfoToClient(otherID, "Client " + to_string(clientID) + " is online", message.send_timestamp);
-            }
         }
 
         else if (cmdStr == "help") {
-            string helpMsg =
-                "Available commands:\n"
-                "1. join <room_name> - Join a chat room\n"
-                "2. leave <room_name> - Leave a chat room\n"
-                "3. say <room_name> <message> - Send message to a room\n"
-                "4. dm <target_client_id> <message> - Direct message to a client\n"
-                "5. online - List online clients\n"
-                "6. help - Show this help message\n";
-            sendInfoToClient(clientID, helpMsg, message.send_timestamp);
+            // msg_text ยาวได้แค่ 256 ไบต์ จึงส่งทีละบรรทัดแทนการรวมเป็นข้อความเดียว
+            static const char *const helpLines[] = {
+                "Available commands:",
+                "1. join <room_name> - Join a chat room",
+                "2. leave <room_name> - Leave a chat room",
+                "3. say <room_name> <message> - Send message to a room",
+                "4. dm <target_client_id> <message> - Direct message to a client",
+                "5. online - List online clients",
+                "6. search <room_name> <terms> [page=N] - Search room history",
+                "7. subscribe <pattern> - Follow rooms matching team.* or team.#",
+                "8. unsubscribe <pattern> - Stop following a pattern",
+                "9. help - Show this help message",
+            };
+            for (const char *line : helpLines) sendInfoToClient(clientID, line, message.send_timestamp);
         }
 
         // handle unknown command
@@ -452,6 +2192,18 @@ public:
     }
 
     ~Router() {
+        // หยุด autoscaler ก่อนเพื่อไม่ให้ resize() ชนกับการ join worker
+        if (service_loop) {
+            service_loop->stop();
+            service_thread.join();
+        }
+        // ระบายงานให้หมดก่อนลบ Client*/Room* และ queue ที่งานในคิวยังอ้างถึง
+        // inbound ก่อนเพราะงาน inbound ส่งต่อเข้า outbound และ federation
+        inbound_pool.shutdown();
+        federation.reset(); // หยุด federation thread ก่อนลบห้องที่มันอาจกำลังใช้อยู่
+        outbound_pool.shutdown();
+        if (reactor_mq != (mqd_t)-1) mq_close(reactor_mq);
+
         for (auto &p : rooms) delete p.second;
         for (auto &p : clients) delete p.second;
 
@@ -461,10 +2213,182 @@ public:
     }
 };
 
+// key ที่รองรับ (ใช้ทั้งไฟล์ config, env และ argv)
+const vector<string> OPTION_KEYS = {
+    "reactor", "mq-name", "loops", "proj-id", "filter-file", "node", "peer",
+    "threads", "inbound-threads", "outbound-threads", "inbound-min", "inbound-max", "outbound-min", "outbound-max",
+    "inbound-cpus", "outbound-cpus", "autoscale", "autoscale-interval-ms", "search-retention",
+};
+
+using OptionMap = map<string, vector<string>>;
+
+static string trim(const string &v) {
+    size_t b = v.find_first_not_of(" \t\r\n");
+    if (b == string::npos) return "";
+    size_t e = v.find_last_not_of(" \t\r\n");
+    return v.substr(b, e - b + 1);
+}
+
+static bool parseBool(const string &v) {
+    return v == "1" || v == "true" || v == "yes" || v == "on";
+}
+
+// "0-3,6" -> {0,1,2,3,6}
+static vector<int> parseCpuList(const string &v) {
+    vector<int> cpus;
+    size_t start = 0;
+    while (start <= v.size()) {
+        size_t comma = v.find(',', start);
+        string part = trim(v.substr(start, comma == string::npos ? string::npos : comma - start));
+        if (!part.empty()) {
+            size_t dash = part.find('-');
+            int lo = stoi(part.substr(0, dash));
+            int hi = dash == string::npos ? lo : stoi(part.substr(dash + 1));
+            if (lo < 0 || hi < lo || hi >= CPU_SETSIZE) throw invalid_argument(part);
+            for (int cpu = lo; cpu <= hi; ++cpu) cpus.push_back(cpu);
+        }
+        if (comma == string::npos) break;
+        start = comma + 1;
+    }
+    return cpus;
+}
+
+// ไฟล์ config: บรรทัดละ key=value, '#' นำหน้าเป็น comment
+OptionMap loadConfigFile(const string &path) {
+    OptionMap values;
+    ifstream in(path);
+    if (!in) {
+        cerr << "[Config] Cannot open config file: " << path << endl;
+        return values;
+    }
+    string line;
+    int lineno = 0;
+    while (getline(in, line)) {
+        ++lineno;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        size_t eq = line.find('=');
+        if (eq == string::npos) {
+            cerr << "[Config] " << path << ":" << lineno << ": expected key=value\n";
+            continue;
+        }
+        values[trim(line.substr(0, eq))].push_back(trim(line.substr(eq + 1)));
+    }
+    return values;
+}
+
+OptionMap loadEnvironment() {
+    OptionMap values;
+    for (const auto &key : OPTION_KEYS) {
+        string env = "CHAT_";
+        for (char c : key) env.push_back(c == '-' ? '_' : (char)toupper((unsigned char)c));
+        if (const char *v = getenv(env.c_str())) values[key].push_back(v);
+    }
+    return values;
+}
+
+// --key=value หรือ --flag (เท่ากับ true)
+OptionMap loadArguments(int argc, char **argv) {
+    OptionMap values;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            cerr << "[Config] Unexpected argument ignored: " << arg << endl;
+            continue;
+        }
+        size_t eq = arg.find('=');
+        string key = arg.substr(2, eq == string::npos ? string::npos : eq - 2);
+        values[key].push_back(eq == string::npos ? "true" : arg.substr(eq + 1));
+    }
+    return values;
+}
+
+void applyOption(ServerOptions &opt, const string &key, const string &value) {
+    try {
+        if (key == "reactor") opt.reactor = parseBool(value);
+        else if (key == "mq-name") opt.mq_name = value.empty() || value[0] != '/' ? "/" + value : value;
+        else if (key == "loops") opt.loops = stoi(value);
+        else if (key == "proj-id") opt.proj_id = stoi(value);
+        else if (key == "filter-file") opt.filter_file = value;
+        else if (key == "node") opt.node = value;
+        else if (key == "peer") {
+            size_t start = 0;
+            while (true) {
+                size_t comma = value.find(',', start);
+                string peer = trim(value.substr(start, comma == string::npos ? string::npos : comma - start));
+                if (!peer.empty()) opt.peers.push_back(peer);
+                if (comma == string::npos) break;
+                start = comma + 1;
+            }
+        }
+        else if (key == "threads") opt.inbound_threads = opt.outbound_threads = stoul(value);
+        else if (key == "inbound-threads") opt.inbound_threads = stoul(value);
+        else if (key == "outbound-threads") opt.outbound_threads = stoul(value);
+        else if (key == "inbound-min") opt.inbound_min = stoul(value);
+        else if (key == "inbound-max") opt.inbound_max = stoul(value);
+        else if (key == "outbound-min") opt.outbound_min = stoul(value);
+        else if (key == "outbound-max") opt.outbound_max = stoul(value);
+        else if (key == "inbound-cpus") opt.inbound_cpus = parseCpuList(value);
+        else if (key == "outbound-cpus") opt.outbound_cpus = parseCpuList(value);
+        else if (key == "autoscale") opt.autoscale = parseBool(value);
+        else if (key == "autoscale-interval-ms") opt.autoscale_interval_ms = stoi(value);
+        else if (key == "search-retention") opt.search_retention = stoul(value);
+        else cerr << "[Config] Unknown option ignored: " << key << endl;
+    } catch (...) {
+        cerr << "[Config] Invalid value for " << key << ": " << value << endl;
+    }
+}
+
+// threads เป็นตัวย่อของ inbound-threads + outbound-threads ภายในชั้นเดียวกัน (ค่าเฉพาะ pool ในชั้นเดียวกันชนะ)
+// ขยายก่อนรวมชั้น เพื่อให้ --threads ใน argv แทนค่าเฉพาะ pool ที่มาจาก config/env ตามกฎชั้นหลังทับชั้นก่อน
+void expandThreads(OptionMap &layer) {
+    auto it = layer.find("threads");
+    if (it == layer.end()) return;
+    for (const char *key : {"inbound-threads", "outbound-threads"})
+        if (!layer.count(key)) layer[key] = it->second;
+    layer.erase(it);
+}
+
+// รวมค่าจากไฟล์ config < env < argv (ชั้นหลังแทนค่าของ key เดียวกันทั้งหมด) แล้วเติมค่าเริ่มต้นที่ขึ้นกับจำนวน core
+ServerOptions parseOptions(int argc, char **argv) {
+    OptionMap args = loadArguments(argc, argv);
+    OptionMap env = loadEnvironment();
+
+    string config_path;
+    if (const char *v = getenv("CHAT_CONFIG")) config_path = v;
+    if (args.count("config")) config_path = args["config"].back();
+    args.erase("config");
+
+    OptionMap file = config_path.empty() ? OptionMap{} : loadConfigFile(config_path);
+    OptionMap merged;
+    for (OptionMap *layer : {&file, &env, &args}) {
+        expandThreads(*layer);
+        for (auto &kv : *layer) merged[kv.first] = kv.second;
+    }
+
+    ServerOptions opt;
+    for (const auto &kv : merged)
+        for (const auto &value : kv.second) applyOption(opt, kv.first, value);
+
+    size_t cores = max(1u, thread::hardware_concurrency());
+    if (opt.inbound_threads == 0) opt.inbound_threads = cores;
+    if (opt.outbound_threads == 0) opt.outbound_threads = cores;
+    if (opt.inbound_max == 0) opt.inbound_max = cores * 4;
+    if (opt.outbound_max == 0) opt.outbound_max = cores * 4;
+    opt.inbound_min = max<size_t>(1, min(opt.inbound_min, opt.inbound_max));
+    opt.outbound_min = max<size_t>(1, min(opt.outbound_min, opt.outbound_max));
+    opt.inbound_threads = max(opt.inbound_min, min(opt.inbound_threads, opt.inbound_max));
+    opt.outbound_threads = max(opt.outbound_min, min(opt.outbound_threads, opt.outbound_max));
+    if (opt.autoscale_interval_ms <= 0) opt.autoscale_interval_ms = 500;
+    return opt;
+}
+
 // ฟังก์ชัน main
-int main() {
+int main(int argc, char **argv) {
+    ServerOptions options = parseOptions(argc, argv);
+
     // กำหนดค่า key สำหรับ Message Queue
-    key_t key = ftok("progfile", 65);
+    key_t key = ftok("progfile", options.proj_id);
     if (key == -1) {
         perror("[Main] ftok failed");
         return 1;
@@ -477,23 +2401,33 @@ int main() {
         return 1;
     }
 
-    cout << "Enter number of threads in pool: ";
-    if (!(cin >> CONFIG_BC_THREAD) || CONFIG_BC_THREAD <= 0) {
-        cerr << "[Main] Invalid thread count, using default 4.\n";
-        CONFIG_BC_THREAD = 4;
-        cin.clear();
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "[Main] Pools: inbound " << options.inbound_threads << " (" << options.inbound_min << "-" << options.inbound_max
+         << "), outbound " << options.outbound_threads << " (" << options.outbound_min << "-" << options.outbound_max
+         << "), autoscale " << (options.autoscale ? "on" : "off") << endl;
+
+    if (options.reactor) {
+        sigset_t mask = shutdownSignals();
+        pthread_sigmask(SIG_BLOCK, &mask, nullptr);
     }
 
     try {
-        Router router(msgid);
-        router.start();
+        Router router(msgid, options);
+        if (options.autoscale)
+            router.enableAutoscale(milliseconds(options.autoscale_interval_ms));
+        if (!options.filter_file.empty())
+            router.enableModeration(options.filter_file);
+        if (!options.node.empty())
+            router.enableFederation(options.node, options.peers);
+        if (options.reactor)
+            router.startReactor(options.mq_name, options.loops);
+        else
+            router.start();
     } catch (const exception &e) {
         cerr << "[Main] Router error: " << e.what() << endl;
     }
 
     // ลบ Message Queue ก่อนจบโปรแกรม (ทำใน destructor ของ Router แล้ว แต่ใส่ซ้ำเพื่อความมั่นใจ)
-    if (msgctl(msgid, IPC_RMID, nullptr) == -1) {
+    if (msgctl(msgid, IPC_RMID, nullptr) == -1 && errno != EINVAL) {
         perror("[Main] msgctl remove failed on exit");
     }
 